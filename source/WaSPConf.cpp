@@ -93,6 +93,26 @@ bool WaSPConfig::parseCommandLine_decoder(int argc, char *argv[]) {
 
         }
 
+        else if (!strcmp(argv[ii], "--view-cache")) {
+            WaSP_setup.view_cache_budget_mb = atoi(argv[ii + 1]);
+
+        }
+
+        else if (!strcmp(argv[ii], "--threads")) {
+            WaSP_setup.n_threads = atoi(argv[ii + 1]);
+
+        }
+
+        else if (!strcmp(argv[ii], "--warp-threads")) {
+            WaSP_setup.n_warp_threads = atoi(argv[ii + 1]);
+
+        }
+
+        else if (!strcmp(argv[ii], "--codec-cache")) {
+            WaSP_setup.codec_cache_directory = std::string(argv[ii + 1]);
+
+        }
+
         else {
             return false;
         }
@@ -119,6 +139,21 @@ bool WaSPConfig::parseCommandLine_decoder(int argc, char *argv[]) {
         return false;
     }
 
+    if (WaSP_setup.view_cache_budget_mb < 0) {
+        printf("\n View cache budget needs to be >= 0\n");
+        return false;
+    }
+
+    if (WaSP_setup.n_threads < 0) {
+        printf("\n Number of threads needs to be >= 0\n");
+        return false;
+    }
+
+    if (WaSP_setup.n_warp_threads < 0) {
+        printf("\n Number of warping threads needs to be >= 0\n");
+        return false;
+    }
+
     WaSP_setup.stats_file = WaSP_setup.output_directory + "/stats.json";
 
     return true;
@@ -129,7 +164,8 @@ void WaSPConfig::print_encoder_help() {
     printf("\n\tUsage: wasp-encoder"
         "\n\t--input [INPUT DIRECTORY .PPM/.PGM]"
         "\n\t--output [OUTPUT DIRECTORY .LF/.PPM/.PGM]"
-        "\n\t--config [JSON CONFIG]"
+        "\n\t--config [JSON CONFIG, can be repeated to encode several rate points,"
+        " each to OUTPUT DIRECTORY/<config name>]"
         "\n\t--kakadu [KAKADU BINARY DIRECTORY]"
         "\n\t--TAppEncoder [Path to TAppEncoder executable]"
         "\n\t--TAppDecoder [Path to TAppDecoder executable]"
@@ -137,7 +173,14 @@ void WaSPConfig::print_encoder_help() {
         "\n\t--kvazaar-path [path to Kvazaar binary]"
         "\n\t--gzip-path [path to gzip binary]"
         "\n\t--sparse_subsampling [Subsampling factor when solving sparse filter,"
-        " needs to be integer >0. Values 2 or 4 will increase encoder speed with some loss in PSNR.]\n\n");
+        " needs to be integer >0. Values 2 or 4 will increase encoder speed with some loss in PSNR.]"
+        "\n\t--view-cache [Memory budget in MB for decoded views kept in RAM, default 2048]"
+        "\n\t--threads [Number of threads for view prediction, default 0 uses all cores]"
+        "\n\t--warp-threads [Number of threads of a single forward warp, default 1, 0 uses all cores]"
+        "\n\t--codec-cache [Directory for caching the runs of HM and Kakadu over encodings, default none]"
+        "\n\t--rate-control [QP search of the HEVC residual, linear (default), parallel or model."
+        " parallel codes several candidate QPs at once using up to --threads HEVC encoders,"
+        " model fits the rate to QP and needs fewer encoder runs but may pick a different QP.]\n\n");
     return;
 }
 
@@ -148,7 +191,11 @@ void WaSPConfig::print_decoder_help() {
         "\n\t--kakadu [KAKADU BINARY DIRECTORY]"
         "\n\t--TAppDecoder [Path to TAppDecoder executable]"
         "\n\t--kvazaar-path [path to Kvazaar binary]"
-        "\n\t--gzip-path [path to gzip binary]\n\n");
+        "\n\t--gzip-path [path to gzip binary]"
+        "\n\t--view-cache [Memory budget in MB for decoded views kept in RAM, default 2048]"
+        "\n\t--threads [Number of threads for view decoding, default 0 uses all cores]"
+        "\n\t--warp-threads [Number of threads of a single forward warp, default 1, 0 uses all cores]"
+        "\n\t--codec-cache [Directory for caching the runs of HM and Kakadu over decodings, default none]\n\n");
     return;
 }
 
@@ -172,11 +219,11 @@ bool WaSPConfig::parseCommandLine_encoder(int argc, char *argv[]) {
     for (int32_t ii = 1; ii < argc-1; ii+=2) {
 
         if (!strcmp(argv[ii], "-c")) {
-            WaSP_setup.config_file = std::string(argv[ii + 1]);
+            WaSP_setup.config_files.push_back(std::string(argv[ii + 1]));
         }
 
         else if (!strcmp(argv[ii], "--config")) {
-            WaSP_setup.config_file = std::string(argv[ii + 1]);
+            WaSP_setup.config_files.push_back(std::string(argv[ii + 1]));
         }
 
         else if (!strcmp(argv[ii], "-i")) {
@@ -253,6 +300,44 @@ bool WaSPConfig::parseCommandLine_encoder(int argc, char *argv[]) {
 
         }
 
+        else if (!strcmp(argv[ii], "--view-cache")) {
+            WaSP_setup.view_cache_budget_mb = atoi(argv[ii + 1]);
+
+        }
+
+        else if (!strcmp(argv[ii], "--threads")) {
+            WaSP_setup.n_threads = atoi(argv[ii + 1]);
+
+        }
+
+        else if (!strcmp(argv[ii], "--warp-threads")) {
+            WaSP_setup.n_warp_threads = atoi(argv[ii + 1]);
+
+        }
+
+        else if (!strcmp(argv[ii], "--codec-cache")) {
+            WaSP_setup.codec_cache_directory = std::string(argv[ii + 1]);
+
+        }
+
+        else if (!strcmp(argv[ii], "--rate-control")) {
+
+            if (!strcmp(argv[ii + 1], "linear")) {
+                WaSP_setup.rate_control = RATE_CONTROL_LINEAR;
+            }
+            else if (!strcmp(argv[ii + 1], "parallel")) {
+                WaSP_setup.rate_control = RATE_CONTROL_PARALLEL;
+            }
+            else if (!strcmp(argv[ii + 1], "model")) {
+                WaSP_setup.rate_control = RATE_CONTROL_MODEL;
+            }
+            else {
+                printf("\n Unknown rate control %s\n", argv[ii + 1]);
+                return false;
+            }
+
+        }
+
         else {
             return false;
         }
@@ -270,11 +355,13 @@ bool WaSPConfig::parseCommandLine_encoder(int argc, char *argv[]) {
         return false;
     }
 
-    if (WaSP_setup.config_file.length() == 0) {
+    if (WaSP_setup.config_files.size() == 0) {
         printf("\n Config file (.json) not set\n");
         return false;
     }
 
+    WaSP_setup.config_file = WaSP_setup.config_files.at(0);
+
     if (WaSP_setup.wasp_kakadu_directory.length() == 0) {
         printf("\n Kakadu directory not set\n");
         return false;
@@ -300,6 +387,21 @@ bool WaSPConfig::parseCommandLine_encoder(int argc, char *argv[]) {
         return false;
     }
 
+    if (WaSP_setup.view_cache_budget_mb < 0) {
+        printf("\n View cache budget needs to be >= 0\n");
+        return false;
+    }
+
+    if (WaSP_setup.n_threads < 0) {
+        printf("\n Number of threads needs to be >= 0\n");
+        return false;
+    }
+
+    if (WaSP_setup.n_warp_threads < 0) {
+        printf("\n Number of warping threads needs to be >= 0\n");
+        return false;
+    }
+
     WaSP_setup.stats_file = WaSP_setup.output_directory + "/stats.json";
 
     return true;
@@ -26,6 +26,9 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
+
+#include "ratecontrol.hh"
 
 using namespace std;
 
@@ -52,9 +55,25 @@ struct WaSPsetup {
 
     /*encoder side only*/
     string config_file;
+    std::vector<string> config_files; /*more than one for batch encoding*/
     string stats_file;
     int32_t sparse_subsampling = 1; 
 
+    /*memory budget for decoded views kept in RAM*/
+    int32_t view_cache_budget_mb = 2048;
+
+    /*number of worker threads, 0 uses all available cores*/
+    int32_t n_threads = 0;
+
+    /*threads of a single forward warp, 0 uses all available cores*/
+    int32_t n_warp_threads = 1;
+
+    /*directory of the cache of external codec runs, empty disables it*/
+    string codec_cache_directory;
+
+    /*encoder side only, QP search of the HEVC residual*/
+    RATE_CONTROL rate_control = RATE_CONTROL_LINEAR;
+
     /*HM specific*/
     string hm_encoder;
     string hm_cfg;
@@ -0,0 +1,238 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <random>
+#include <system_error>
+#include <experimental/filesystem>
+
+#include "codeccache.hh"
+#include "fileaux.hh"
+
+namespace fs = std::experimental::filesystem;
+
+static std::string codec_cache_directory;
+
+/* hashes of the codec binaries, these are hashed once per process */
+static std::mutex binary_hash_mutex;
+static std::map<std::string, uint64_t> binary_hash;
+
+void codec_cache_set_directory(const std::string &directory) {
+    codec_cache_directory = directory;
+}
+
+bool codec_cache_enabled() {
+    return codec_cache_directory.length() > 0;
+}
+
+/* 64-bit multiply-xorshift hash over 8-byte words */
+static uint64_t hash_bytes(
+    const uint8_t *data,
+    const size_t size,
+    uint64_t h) {
+
+    const uint64_t m = 0x9E3779B97F4A7C15ULL;
+
+    size_t ii = 0;
+
+    for (; ii + 8 <= size; ii += 8) {
+
+        uint64_t w;
+        memcpy(&w, data + ii, 8);
+
+        h = (h ^ w) * m;
+        h ^= h >> 32;
+
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, data + ii, size - ii);
+
+    h = (h ^ tail ^ (static_cast<uint64_t>(size) << 56)) * m;
+    h ^= h >> 29;
+
+    return h;
+
+}
+
+static uint64_t hash_string(const std::string &str, const uint64_t h) {
+    return hash_bytes(
+        reinterpret_cast<const uint8_t*>(str.data()),
+        str.size(),
+        h);
+}
+
+/* contents of the file, or its name if it does not exist */
+static uint64_t hash_file(const std::string &filename, const uint64_t h) {
+
+    aux_mapped_file mfile;
+
+    if (aux_GetFileSize(filename) <= 0 || !aux_map_file(filename.c_str(), mfile)) {
+        return hash_string(filename, h);
+    }
+
+    uint64_t hf = hash_bytes(mfile.data, mfile.size, h);
+
+    aux_unmap_file(mfile);
+
+    return hf;
+
+}
+
+uint64_t codec_cache_key(
+    const char *codec_binary,
+    const std::vector<std::string> &input_files,
+    const std::string &parameters) {
+
+    uint64_t h;
+
+    {
+        std::lock_guard<std::mutex> lock(binary_hash_mutex);
+
+        auto it = binary_hash.find(codec_binary);
+
+        if (it == binary_hash.end()) {
+            it = binary_hash.emplace(
+                codec_binary,
+                hash_file(codec_binary, 0)).first;
+        }
+
+        h = it->second;
+    }
+
+    for (const std::string &filename : input_files) {
+        h = hash_file(filename, h);
+    }
+
+    return hash_string(parameters, h);
+
+}
+
+static std::string entry_directory(const uint64_t key) {
+
+    char name[32];
+    sprintf(name, "%016llx", static_cast<unsigned long long>(key));
+
+    return codec_cache_directory + "/" + name;
+
+}
+
+static std::string entry_file(const std::string &directory, const size_t ii) {
+    return directory + "/" + std::to_string(ii);
+}
+
+bool codec_cache_fetch(
+    const uint64_t key,
+    const std::vector<std::string> &output_files) {
+
+    if (!codec_cache_enabled()) {
+        return false;
+    }
+
+    const std::string directory = entry_directory(key);
+
+    if (!aux_exists(directory)) {
+        return false;
+    }
+
+    for (size_t ii = 0; ii < output_files.size(); ii++) {
+
+        aux_ensure_directory(output_files.at(ii));
+
+        std::error_code ec;
+
+        fs::copy_file(
+            entry_file(directory, ii),
+            output_files.at(ii),
+            fs::copy_options::overwrite_existing,
+            ec);
+
+        if (ec) {
+            return false;
+        }
+
+    }
+
+    return true;
+
+}
+
+void codec_cache_store(
+    const uint64_t key,
+    const std::vector<std::string> &output_files) {
+
+    if (!codec_cache_enabled()) {
+        return;
+    }
+
+    const std::string directory = entry_directory(key);
+
+    if (aux_exists(directory)) {
+        return;
+    }
+
+    /* the entry is filled in a private directory and renamed in place, so
+    that concurrent runs (threads or processes) never see a partial one */
+
+    std::random_device random;
+
+    char suffix[64];
+    sprintf(
+        suffix,
+        ".tmp%zx_%x",
+        std::hash<std::thread::id>()(std::this_thread::get_id()),
+        random());
+
+    const std::string tmp_directory = directory + suffix;
+
+    std::error_code ec;
+
+    fs::create_directories(tmp_directory, ec);
+
+    for (size_t ii = 0; ii < output_files.size() && !ec; ii++) {
+
+        fs::copy_file(
+            output_files.at(ii),
+            entry_file(tmp_directory, ii),
+            fs::copy_options::overwrite_existing,
+            ec);
+
+    }
+
+    if (!ec) {
+        fs::rename(tmp_directory, directory, ec);
+    }
+
+    if (ec) {
+        fs::remove_all(tmp_directory, ec);
+    }
+
+}
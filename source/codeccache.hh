@@ -0,0 +1,69 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CODECCACHE_HH
+#define CODECCACHE_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::int32_t;
+using std::uint32_t;
+
+using std::uint64_t;
+
+/* Persistent on-disk cache of the runs of external codecs (HM, Kakadu). A
+run is keyed by a hash of the contents of the codec binary and of its input
+files (image, YUV sequence, codec .cfg) and of the remaining parameters
+(QP, rate, dimensions, ...), but not by the output paths. The outputs of a
+run are stored in a directory named by the key, and a later run with the
+same key gets copies of them without spawning the codec. This pays off
+over rate sweeps, where e.g. the level-1 depth and the low levels are
+coded identically for every rate point. The cache is disabled unless a
+directory is set, it is never cleaned up by the codec. */
+
+void codec_cache_set_directory(const std::string &directory);
+
+bool codec_cache_enabled();
+
+uint64_t codec_cache_key(
+    const char *codec_binary,
+    const std::vector<std::string> &input_files,
+    const std::string &parameters);
+
+/* copies the outputs stored under key to output_files, false if the run is
+not in the cache */
+bool codec_cache_fetch(
+    const uint64_t key,
+    const std::vector<std::string> &output_files);
+
+/* stores output_files under key */
+void codec_cache_store(
+    const uint64_t key,
+    const std::vector<std::string> &output_files);
+
+#endif
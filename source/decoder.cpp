@@ -31,6 +31,7 @@
 #include <numeric>
 #include <fstream>
 #include <iomanip>
+#include <algorithm>
 
 #include "fileaux.hh"
 #include "json.hh"
@@ -42,12 +43,19 @@
 #include "residual.hh"
 #include "medianfilter.hh"
 #include "ppm.hh"
+#include "planar.hh"
 #include "warping.hh"
 #include "merging.hh"
 #include "inpainting.hh"
 #include "sparsefilter.hh"
 #include "WaSPConf.hh"
 #include "segmentation.hh"
+#include "viewcache.hh"
+#include "taskgraph.hh"
+#include "codeccache.hh"
+#include "processpool.hh"
+
+#include <thread>
 
 #define SAVE_PARTIAL_WARPED_VIEWS false
 
@@ -72,9 +80,26 @@ void decoder::decode() {
 
     aux_ensure_directory(setup.output_directory);
 
+    viewcache_set_budget(
+        static_cast<int64_t>(setup.view_cache_budget_mb) * 1024 * 1024);
+
+    codec_cache_set_directory(setup.codec_cache_directory);
+
+    if (setup.n_threads == 0) {
+        setup.n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    if (setup.n_warp_threads == 0) {
+        setup.n_warp_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    warping_set_threads(setup.n_warp_threads);
+
     decode_header();
     decode_views();
     write_statsfile();
+
+    viewcache_clear();
 }
 
 void decoder::write_statsfile() {
@@ -221,15 +246,30 @@ void decoder::decode_header() {
         1,
         input_LF) * sizeof(uint8_t);
 
-    uint8_t usedeflate = 0;
+    /* bit 0 deflate, bit 1 median filtered normalized disparity followed
+    by the window size */
+    uint8_t header_flags = 0;
 
     n_bytes_prediction += (uint32_t)fread(
-        &usedeflate,
+        &header_flags,
         sizeof(uint8_t),
         1,
         input_LF) * sizeof(uint8_t);
 
-    USE_DEFLATE = usedeflate;
+    USE_DEFLATE = (header_flags & 1) > 0;
+
+    if (header_flags & 2) {
+
+        uint8_t median_size = 0;
+
+        n_bytes_prediction += (uint32_t)fread(
+            &median_size,
+            sizeof(uint8_t),
+            1,
+            input_LF) * sizeof(uint8_t);
+
+        depth_median_size = median_size;
+    }
 
     if (USE_DEFLATE && (setup.gzipath.length() == 0) )
     {
@@ -242,45 +282,52 @@ void decoder::decode_header() {
 void decoder::forward_warp_texture_references(
     view *LF,
     view *SAI,
-    uint16_t **warped_texture_views,
-    uint16_t **warped_depth_views,
-    float **DispTargs) {
+    warped_references &refs) {
+
+    init_warped_references(
+        SAI->n_references,
+        SAI->nr,
+        SAI->nc,
+        SAI->ncomp,
+        refs);
 
     for (int32_t ij = 0; ij < SAI->n_references; ij++) {
 
         view *ref_view = LF + SAI->references[ij];
 
-        int32_t tmp_w, tmp_r, tmp_ncomp;
+        /* decoded reference from the view cache, the texture stays pinned
+        until the view has been merged */
+        const uint16_t *ref_normdisp =
+            viewcache_acquire(ref_view, VIEWCACHE_NORMDISP);
+        refs.textures[ij] =
+            viewcache_acquire(ref_view, VIEWCACHE_TEXTURE);
 
-        aux_read16PGMPPM(
-            ref_view->path_out_pgm,
-            tmp_w,
-            tmp_r,
-            tmp_ncomp,
-            ref_view->depth);
+        warp_table table;
 
-        aux_read16PGMPPM(
-            ref_view->path_internal_colorspace_out_ppm,
-            tmp_w,
-            tmp_r,
-            tmp_ncomp,
-            ref_view->color);
-
-        /* FORWARD warp color */
-        warpView0_to_View1(
+        make_warp_table(ref_view, SAI, ref_normdisp, table);
+
+        /* FORWARD warp, winning reference pixels only */
+        warpView0_to_View1_source(
             ref_view,
-            SAI,
-            warped_texture_views[ij],
-            warped_depth_views[ij],
-            DispTargs[ij]);
+            table,
+            ref_normdisp,
+            refs.source.data() + static_cast<size_t>(ij)*refs.nrnc);
 
-        delete[](ref_view->depth);
-        delete[](ref_view->color);
+        if (SAVE_PARTIAL_WARPED_VIEWS) {
 
-        ref_view->depth = nullptr;
-        ref_view->color = nullptr;
+            /* full warped reference for inspection */
+            uint16_t *warped_texture = new uint16_t[SAI->nr*SAI->nc * 3]();
+            uint16_t *warped_depth = new uint16_t[SAI->nr*SAI->nc]();
+            float *DispTarg = new float[SAI->nr*SAI->nc]();
 
-        if (SAVE_PARTIAL_WARPED_VIEWS) {
+            warpView0_to_View1(
+                ref_view,
+                table,
+                refs.textures[ij],
+                ref_normdisp,
+                warped_texture,
+                warped_depth,
+                DispTarg);
 
             char tmp_str[1024];
 
@@ -297,7 +344,7 @@ void decoder::forward_warp_texture_references(
                 tmp_str, 
                 SAI->nc, 
                 SAI->nr, 3, 
-                warped_texture_views[ij]);
+                warped_texture);
 
             sprintf(
                 tmp_str, 
@@ -313,32 +360,39 @@ void decoder::forward_warp_texture_references(
                 SAI->nc, 
                 SAI->nr, 
                 1, 
-                warped_depth_views[ij]);
+                warped_depth);
+
+            delete[](warped_texture);
+            delete[](warped_depth);
+            delete[](DispTarg);
 
         }
 
-    }
+        viewcache_unpin(ref_view, VIEWCACHE_NORMDISP);
 
+    }
 
 }
 
+void decoder::release_texture_references(
+    view *LF,
+    view *SAI) {
+
+    for (int32_t ij = 0; ij < SAI->n_references; ij++) {
+        viewcache_unpin(LF + SAI->references[ij], VIEWCACHE_TEXTURE);
+    }
+}
 
 void decoder::merge_texture_views(
     view *SAI,
     view *LF,
-    uint16_t **warped_texture_views,
-    float **DispTargs) {
+    const warped_references &refs) {
 
-    initViewW(SAI, DispTargs);
+    initViewW(SAI, refs);
 
     if (SAI->mmode == 0) {
 
-        for (int32_t icomp = 0; icomp < SAI->ncomp; icomp++) {
-            mergeWarped_N_icomp(
-                warped_texture_views,
-                SAI,
-                icomp);
-        }
+        mergeWarped_N(refs, SAI, SAI->ncomp);
 
         /* hole filling for texture*/
         for (int32_t icomp = 0; icomp < SAI->ncomp; icomp++) {
@@ -361,12 +415,7 @@ void decoder::merge_texture_views(
         }
 
         /* merge color with prediction */
-        for (int32_t icomp = 0; icomp < SAI->ncomp; icomp++) {
-            mergeWarped_N_icomp(
-                warped_texture_views,
-                SAI,
-                icomp);
-        }
+        mergeWarped_N(refs, SAI, SAI->ncomp);
 
         /* hole filling for texture*/
         for (int32_t icomp = 0; icomp < 3; icomp++) {
@@ -381,7 +430,7 @@ void decoder::merge_texture_views(
 
     if (SAI->mmode == 2) {
 
-        mergeMedian_N(warped_texture_views, DispTargs, SAI, 3);
+        mergeMedian_N(refs, SAI, 3);
 
         /* hole filling for texture*/
         for (int32_t icomp = 0; icomp < 3; icomp++) {
@@ -407,56 +456,28 @@ void decoder::predict_texture_view(view* SAI) {
 
         printf("Predicting texture for view %03d_%03d\n", SAI->c, SAI->r);
 
-        uint16_t **warped_texture_views = nullptr;
-        uint16_t **warped_depth_views = nullptr;
-        float **DispTargs = nullptr;
+        warped_references refs;
 
-        init_warping_arrays(
-            SAI->n_references,
-            warped_texture_views,
-            warped_depth_views,
-            DispTargs,
-            SAI->nr,
-            SAI->nc,
-            SAI->ncomp);
+        forward_warp_texture_references(LF, SAI, refs);
 
-        forward_warp_texture_references(
-            LF,
-            SAI,
-            warped_texture_views,
-            warped_depth_views,
-            DispTargs);
+        merge_texture_views(SAI, LF, refs);
 
-        merge_texture_views(
-            SAI,
-            LF,
-            warped_texture_views,
-            DispTargs);
-
-        clean_warping_arrays(
-            SAI->n_references,
-            warped_texture_views,
-            warped_depth_views,
-            DispTargs);
+        release_texture_references(LF, SAI);
 
         if (SAI->use_global_sparse) {
 
             /* OBTAIN SEGMENTATION*/
             segmentation seg = makeSegmentation(SAI, n_seg_iterations);
 
-            /*READ DECODED REFERENCE VIEWS*/
+            /*DECODED REFERENCE VIEWS FROM THE VIEW CACHE*/
+            std::vector<const uint16_t*> ref_textures;
+
             for (int ikr = 0; ikr < SAI->n_references; ikr++) {
 
                 view *ref_view = LF + SAI->references[ikr];
 
-                int32_t tmp_w, tmp_r, tmp_ncomp;
-
-                aux_read16PGMPPM(
-                    ref_view->path_internal_colorspace_out_ppm,
-                    tmp_w,
-                    tmp_r,
-                    tmp_ncomp,
-                    ref_view->color);
+                ref_textures.push_back(
+                    viewcache_acquire(ref_view, VIEWCACHE_TEXTURE));
 
             }
 
@@ -485,11 +506,9 @@ void decoder::predict_texture_view(view* SAI) {
                 if (SP_B) {
                     for (int ikr = 0; ikr < SAI->n_references; ikr++) {
 
-                        view *ref_view = LF + SAI->references[ikr];
-
                         padded_regressors.push_back(
                             padArrayUint16_t_vec(
-                                ref_view->color + SAI->nr*SAI->nc*icomp,
+                                ref_textures.at(ikr) + SAI->nr*SAI->nc*icomp,
                                 SAI->nr,
                                 SAI->nc,
                                 SAI->NNt));
@@ -554,8 +573,7 @@ void decoder::predict_texture_view(view* SAI) {
 
                 view *ref_view = LF + SAI->references[ikr];
 
-                delete[](ref_view->color);
-                ref_view->color = nullptr;
+                viewcache_unpin(ref_view, VIEWCACHE_TEXTURE);
 
             }
 
@@ -672,13 +690,52 @@ void decoder::decode_views() {
         }
     }
 
-    /* extract texture residuals from hevc stream */
+    plan = plan_decoder_views(LF, number_of_views, n_seg_iterations);
+
+    print_view_plan(
+        plan,
+        LF,
+        static_cast<int64_t>(setup.view_cache_budget_mb) * 1024 * 1024);
+
+    /* the JP2 normalized disparities are independent of each other and
+    expanded as one batch up front */
+
+    process_pool pool(setup.n_threads);
+
+    for (uint32_t ii = 0; ii < number_of_views; ii++) {
+
+        view *SAI = LF + ii;
+
+        if (SAI->has_depth_residual) {
+            pool.add([this, SAI]() {
+                printf("Decoding normalized disparity for view %03d_%03d\n", SAI->c, SAI->r);
+                return decodeKakadu(
+                    SAI->path_out_pgm,
+                    (setup.wasp_kakadu_directory + "/kdu_expand").c_str(),
+                    SAI->jp2_residual_depth_path_jp2);
+            });
+        }
+    }
+
+    pool.run();
+
     maxh = get_highest_level(LF, number_of_views);
 
-    for (int32_t hlevel = 1; hlevel <= maxh; hlevel++) {
+    residual_seqs.resize(maxh + 1);
+    residual_frame.assign(number_of_views, -1);
+
+    /* The HEVC stream of every level (extracted from the codestream above)
+    is decoded by a task of its own, these start right away and run
+    concurrently. Every view is a task which starts once the views it
+    references are decoded and the HEVC stream of its level is decoded, so
+    the views of level h are reconstructed while the streams of the higher
+    levels are still being decoded. */
+
+    task_graph graph;
 
-        printf("\nDecoding HEVC texture of hierarchical level: %d\n\n",
-            hlevel);
+    std::vector<int32_t> hevc_task(maxh + 1, -1);
+
+    for (int32_t hlevel = 1; hlevel <= maxh; hlevel++) {
 
         std::vector< int32_t > view_indices;
 
@@ -688,8 +745,10 @@ void decoder::decode_views() {
             }
         }
 
+        const int32_t n_level_views = static_cast<int32_t>(view_indices.size());
+
         bool texture_residual_for_level = false;
-        for (int32_t iii = 0; iii < view_indices.size(); iii++) {
+        for (int32_t iii = 0; iii < n_level_views; iii++) {
             if ((LF + view_indices.at(iii))->has_color_residual) {
                 texture_residual_for_level = true;
                 break;
@@ -702,228 +761,235 @@ void decoder::decode_views() {
             std::vector<int32_t> hevc_i_order =
                 getScanOrder(LF, view_indices);
 
-            /*padding to mincusize*/
-
-            const int32_t mincusize = 8;
+            hevc_task.at(hlevel) = graph.add_task([this, hlevel, hevc_i_order]() {
+                decode_texture_residual(hlevel, hevc_i_order);
+            });
+        }
+    }
 
-            const int32_t VERP = mincusize*((LF->nr % mincusize) ?
-                LF->nr / mincusize + 1 : LF->nr / mincusize )- LF->nr;
-            const int32_t HORP = mincusize*((LF->nc % mincusize) ?
-                LF->nc / mincusize + 1 : LF->nc / mincusize) - LF->nc;
+    std::vector<std::vector<int32_t>> dependencies =
+        view_plan_dependencies(plan);
 
-            int32_t nr1 = LF->nr + VERP;
-            int32_t nc1 = LF->nc + HORP;
+    const int32_t n_steps = static_cast<int32_t>(plan.steps.size());
 
-            view *SAI0 = LF + hevc_i_order.at(0);
+    std::vector<int32_t> step_task(n_steps, -1);
 
-            int32_t status = decodeHM(
-                SAI0->hevc_texture,
-                SAI0->decoder_raw_output_YUV,
-                setup.hm_decoder.c_str());
+    for (int32_t step = 0; step < n_steps; step++) {
 
-            /*convert (any YUV format) -> YUV444 */
+        view *SAI = LF + plan.steps.at(step).i_order;
 
-            std::vector<std::vector<uint16_t>> YUV444_dec = convertYUVseqTo444(
-                SAI0->decoder_raw_output_YUV,
-                hlevel > 1 ? YUVTYPE : (nc_color_ref > 1 ? YUV444 : YUV400),
-                nr1,
-                nc1,
-                hevc_i_order.size());
+        step_task.at(step) = graph.add_task([this, SAI]() {
+            decode_view(SAI);
+        });
 
-            for (int32_t ii = 0; ii < view_indices.size(); ii++) {
+        for (int32_t before : dependencies.at(step)) {
+            graph.add_dependency(step_task.at(before), step_task.at(step));
+        }
 
-                view *SAI = LF + hevc_i_order.at(ii);
+        if (SAI->level <= maxh && hevc_task.at(SAI->level) >= 0) {
+            graph.add_dependency(hevc_task.at(SAI->level), step_task.at(step));
+        }
+    }
 
-                if (SAI->has_color_residual) {
+    graph.run(setup.n_threads);
 
-                    uint16_t *cropped = cropImage_for_HM(
-                        YUV444_dec.at(ii).data(),
-                        nr1,
-                        nc1,
-                        SAI->ncomp,
-                        HORP,
-                        VERP);
+    for (int32_t hlevel = 1; hlevel <= maxh; hlevel++) {
+        close_decoded_residual_seq(residual_seqs.at(hlevel));
+    }
+}
 
-                    aux_write16PGMPPM(
-                        SAI->path_raw_texture_residual_at_decoder_ppm,
-                        SAI->nc,
-                        SAI->nr,
-                        SAI->ncomp,
-                        cropped);
+/* decodes the HEVC texture residual of a level, hevc_i_order is the order
+of the views in the sequence */
+void decoder::decode_texture_residual(
+    const int32_t hlevel,
+    const std::vector<int32_t> &hevc_i_order) {
 
-                    delete[](cropped);
+    printf("\nDecoding HEVC texture of hierarchical level: %d\n\n",
+        hlevel);
 
-                }
+    const int32_t n_level_views = static_cast<int32_t>(hevc_i_order.size());
 
-            }
+    /*padding to mincusize*/
 
-            /* ------------------------------
-            TEXTURE RESIDUAL DECODING ENDS
-            ------------------------------*/
+    const int32_t mincusize = 8;
 
-        }
-    }
+    const int32_t VERP = mincusize*((LF->nr % mincusize) ?
+        LF->nr / mincusize + 1 : LF->nr / mincusize )- LF->nr;
+    const int32_t HORP = mincusize*((LF->nc % mincusize) ?
+        LF->nc / mincusize + 1 : LF->nc / mincusize) - LF->nc;
 
-    for (uint32_t ii = 0; ii < number_of_views; ii++)
-    {
+    int32_t nr1 = LF->nr + VERP;
+    int32_t nc1 = LF->nc + HORP;
 
-        view *SAI = LF + ii;
+    view *SAI0 = LF + hevc_i_order.at(0);
 
-        printf("Decoding view %03d_%03d\n", SAI->c, SAI->r);
+    int32_t status = decodeHM(
+        SAI0->hevc_texture,
+        SAI0->decoder_raw_output_YUV,
+        setup.hm_decoder.c_str());
 
-        SAI->color = new uint16_t[SAI->nr * SAI->nc * 3]();
-        SAI->depth = new uint16_t[SAI->nr * SAI->nc]();
+    /* residuals are applied from the decoded sequence,
+    (any YUV format) -> padded YUV444 frame views */
 
-        if (SAI->has_depth_residual) {
+    if (!open_decoded_residual_seq(
+        SAI0->decoder_raw_output_YUV,
+        hlevel > 1 ? YUVTYPE : (nc_color_ref > 1 ? YUV444 : YUV400),
+        nr1,
+        nc1,
+        n_level_views,
+        residual_seqs.at(hlevel)))
+    {
+        exit(0);
+    }
 
-            delete[](SAI->depth);
+    for (int32_t ii = 0; ii < n_level_views; ii++) {
+        residual_frame.at(LF[hevc_i_order.at(ii)].i_order) = ii;
+    }
 
-            /* has JP2 encoded depth */
+    /* ------------------------------
+    TEXTURE RESIDUAL DECODING ENDS
+    ------------------------------*/
 
-            decodeKakadu(
-                SAI->path_out_pgm,
-                (setup.wasp_kakadu_directory + "/kdu_expand").c_str(),
-                SAI->jp2_residual_depth_path_jp2);
+}
 
-            int32_t nr1, nc1, ncomp1;
+void decoder::decode_view(view *SAI) {
 
-            aux_read16PGMPPM(
-                SAI->path_out_pgm,
-                nc1,
-                nr1,
-                ncomp1,
-                SAI->depth);
+    printf("Decoding view %03d_%03d\n", SAI->c, SAI->r);
 
-        }
-        else {
+    SAI->color = new uint16_t[SAI->nr * SAI->nc * 3]();
+    SAI->depth = new uint16_t[SAI->nr * SAI->nc]();
 
-            /*inverse depth prediction*/
+    if (SAI->has_depth_residual) {
 
-            if (SAI->level <= maxh) {
-                WaSP_predict_depth(SAI, LF);
-            }
+        delete[](SAI->depth);
 
-        }
+        /* has JP2 encoded depth, expanded in decode_views() */
 
-        if (MEDFILT_DEPTH) {
+        int32_t nr1, nc1, ncomp1;
 
-            uint16_t *filtered_depth = medfilt2D(
-                SAI->depth,
-                3,
-                SAI->nr,
-                SAI->nc);
+        aux_read16PGMPPM(
+            SAI->path_out_pgm,
+            nc1,
+            nr1,
+            ncomp1,
+            SAI->depth);
 
-            memcpy(
-                SAI->depth,
-                filtered_depth,
-                sizeof(uint16_t) * SAI->nr * SAI->nc);
+    }
+    else {
 
-            delete[](filtered_depth);
+        /*inverse depth prediction*/
 
+        if (SAI->level <= maxh) {
+            WaSP_predict_depth(SAI, LF);
         }
 
-        /*write inverse depth .pgm*/
-        //if (SAI->level < maxh) {
-        aux_write16PGMPPM(
-            SAI->path_out_pgm,
-            SAI->nc,
-            SAI->nr,
-            1,
-            SAI->depth);
-        //}
+    }
 
-        /*main texture prediction here*/
-        predict_texture_view(SAI);
+    if (depth_median_size > 0) {
 
-        /* apply texture residual */
-        if (SAI->has_color_residual) {
+        uint16_t *filtered_depth = medfilt2D_uint16(
+            SAI->depth,
+            depth_median_size,
+            SAI->nr,
+            SAI->nc);
 
-            int32_t Q = 1;
-            int32_t offset = 0;
+        memcpy(
+            SAI->depth,
+            filtered_depth,
+            sizeof(uint16_t) * SAI->nr * SAI->nc);
 
-            if (SAI->level > 1) {
-                Q = 2;
-                const int32_t bpc = 10;
-                offset = (1 << bpc) - 1; /* 10bit images currently */
-            }
+        delete[](filtered_depth);
 
-            uint16_t *decoded_residual_image;
+    }
 
-            aux_read16PGMPPM(
-                SAI->path_raw_texture_residual_at_decoder_ppm,
-                SAI->nc,
-                SAI->nr,
-                SAI->ncomp,
-                decoded_residual_image);
+    /*write inverse depth .pgm*/
+    //if (SAI->level < maxh) {
+    aux_write16PGMPPM(
+        SAI->path_out_pgm,
+        SAI->nc,
+        SAI->nr,
+        1,
+        SAI->depth);
+    //}
 
-            double *residual = dequantize_residual(
-                decoded_residual_image,
-                SAI->nr,
-                SAI->nc,
-                SAI->ncomp,
-                10,
-                Q,
-                offset);
+    view_plan_store(
+        plan,
+        plan.normdisp_step.at(SAI->i_order),
+        SAI,
+        VIEWCACHE_NORMDISP,
+        SAI->depth);
 
-            uint16_t *corrected = apply_residual(
-                SAI->color,
-                residual,
-                SAI->nr,
-                SAI->nc,
-                SAI->ncomp,
-                10);
+    /*main texture prediction here*/
+    predict_texture_view(SAI);
 
-            /* update SAI->color to contain
-            corrected (i.e., prediction + residual) version*/
-            memcpy(
-                SAI->color,
-                corrected,
-                sizeof(uint16_t)*SAI->nr*SAI->nc*SAI->ncomp);
+    /* apply texture residual */
+    if (SAI->has_color_residual) {
 
-            delete[](residual);
-            delete[](corrected);
-            delete[](decoded_residual_image);
+        int32_t Q = 1;
+        int32_t offset = 0;
 
-        }  
+        if (SAI->level > 1) {
+            Q = 2;
+            const int32_t bpc = 10;
+            offset = (1 << bpc) - 1; /* 10bit images currently */
+        }
 
-        /*internal colorspace version*/
-        aux_write16PGMPPM(
-            SAI->path_internal_colorspace_out_ppm,
-            SAI->nc,
-            SAI->nr,
-            SAI->ncomp,
-            SAI->color);
-
-        /*colorspace transformation back to input and,
-        writing .ppm in output colorspace,
-        If we only encode luminance, we have luminance as the first
-        component of the .ppm file !
-        */
-        write_output_ppm(
+        /* update SAI->color to contain
+        corrected (i.e., prediction + residual) version*/
+        apply_residual_view(
             SAI->color,
-            SAI->path_out_ppm,
+            get_residual_frame(
+                residual_seqs.at(SAI->level),
+                residual_frame.at(SAI->i_order)),
             SAI->nr,
             SAI->nc,
-            nc_color_ref,
+            SAI->ncomp,
             10,
-            SAI->colorspace);
-
-        if (SAI->color != nullptr) {
-            delete[](SAI->color);
-            SAI->color = nullptr;
-        }
-
-        if (SAI->depth != nullptr) {
-            delete[](SAI->depth);
-            SAI->depth = nullptr;
-        }
+            Q,
+            offset);
+
+    }  
+
+    /*internal colorspace version, kept for the views referencing it*/
+    view_plan_store(
+        plan,
+        plan.texture_step.at(SAI->i_order),
+        SAI,
+        VIEWCACHE_TEXTURE,
+        SAI->color);
+
+    /* reference views no longer needed are released */
+    view_plan_step_done(plan, plan.texture_step.at(SAI->i_order), LF);
+
+    /*colorspace transformation back to input and,
+    writing .ppm in output colorspace,
+    If we only encode luminance, we have luminance as the first
+    component of the .ppm file !
+    */
+    write_output_ppm(
+        SAI->color,
+        SAI->path_out_ppm,
+        SAI->nr,
+        SAI->nc,
+        nc_color_ref,
+        10,
+        SAI->colorspace);
+
+    if (SAI->color != nullptr) {
+        delete[](SAI->color);
+        SAI->color = nullptr;
+    }
 
-        if (SAI->seg_vp != nullptr) {
-            delete[](SAI->seg_vp);
-            SAI->seg_vp = nullptr;
-        }
+    if (SAI->depth != nullptr) {
+        delete[](SAI->depth);
+        SAI->depth = nullptr;
+    }
 
+    if (SAI->seg_vp != nullptr) {
+        delete[](SAI->seg_vp);
+        SAI->seg_vp = nullptr;
     }
+
 }
 
 void decoder::dealloc() {
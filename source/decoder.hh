@@ -29,6 +29,9 @@
 #include <cstdint>
 
 #include "view.hh"
+#include "viewplan.hh"
+#include "merging.hh"
+#include "residual.hh"
 #include "bitdepth.hh"
 #include "WaSPConf.hh"
 
@@ -63,8 +66,18 @@ private:
 
     bool USE_DEFLATE = false;
 
+    /* window of the median filter on normalized disparity, 0 for none */
+    int32_t depth_median_size = 0;
+
     WaSPsetup setup;
 
+    view_plan plan; /* lifetimes of decoded views */
+
+    /* decoded HEVC residuals per level, frame residual_frame[i_order]
+    of residual_seqs[level] belongs to view i_order */
+    std::vector<decoded_residual_seq> residual_seqs;
+    std::vector<int32_t> residual_frame;
+
     view* LF = nullptr;
     FILE* input_LF = nullptr;
     std::vector<std::vector<uint8_t>> JP2_dict;
@@ -80,21 +93,26 @@ protected:
     void write_statsfile();
     void decode_header();
     void decode_views();
+    void decode_view(view *SAI);
+    void decode_texture_residual(
+        const int32_t hlevel,
+        const std::vector<int32_t> &hevc_i_order);
 
     void predict_texture_view(view* SAI);
 
     void merge_texture_views(
         view *SAI,
         view *LF,
-        uint16_t **warped_texture_views,
-        float **DispTargs);
+        const warped_references &refs);
 
     void forward_warp_texture_references(
         view *LF,
         view *SAI,
-        uint16_t **warped_texture_views,
-        uint16_t **warped_depth_views,
-        float **DispTargs);
+        warped_references &refs);
+
+    void release_texture_references(
+        view *LF,
+        view *SAI);
 
     template<class T>
     T clip(T value, T min, T max) {
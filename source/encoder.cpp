@@ -26,10 +26,12 @@
 
 #include <fstream>
 #include <iomanip>
+#include <algorithm>
 #include <string>
 
 #include "encoder.hh"
 #include "ppm.hh"
+#include "planar.hh"
 #include "fileaux.hh"
 #include "codestream.hh"
 #include "residual.hh"
@@ -45,6 +47,14 @@
 #include "warping.hh"
 #include "bitdepth.hh"
 #include "segmentation.hh"
+#include "viewcache.hh"
+#include "taskgraph.hh"
+#include "codeccache.hh"
+#include "processpool.hh"
+#include "ratecontrol.hh"
+
+#include <thread>
+#include <memory>
 
 encoder::encoder(const WaSPsetup encoder_setup)
 {
@@ -69,12 +79,211 @@ encoder::~encoder() {
 
 void encoder::encode() {
 
-    aux_ensure_directory(setup.output_directory);
+    begin_encoding();
 
-    generate_normalized_disparity();
-    generate_texture();
+    generate_views();
     write_bitstream();
 
+    viewcache_clear();
+
+}
+
+void encoder::begin_encoding() {
+
+    aux_ensure_directory(setup.output_directory);
+
+    const int64_t view_cache_budget =
+        static_cast<int64_t>(setup.view_cache_budget_mb) * 1024 * 1024;
+
+    viewcache_set_budget(view_cache_budget);
+
+    codec_cache_set_directory(setup.codec_cache_directory);
+
+    if (setup.n_threads == 0) {
+        setup.n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    if (setup.n_warp_threads == 0) {
+        setup.n_warp_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    warping_set_threads(setup.n_warp_threads);
+
+    plan = plan_encoder_views(LF, n_views_total, n_seg_iterations);
+    print_view_plan(plan, LF, view_cache_budget);
+
+}
+
+void encoder::encode_batch(const WaSPsetup &batch_setup) {
+
+    const int32_t n_configs =
+        static_cast<int32_t>(batch_setup.config_files.size());
+
+    int32_t n_threads = batch_setup.n_threads;
+
+    if (n_threads == 0) {
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /* the input views are read and color converted once for all configs */
+    share_input_views(true);
+
+    /* one encoder per config, output to <output>/<config name> */
+
+    std::vector<std::unique_ptr<encoder>> encoders;
+
+    for (const string &config_file : batch_setup.config_files) {
+
+        WaSPsetup rate_setup = batch_setup;
+
+        rate_setup.config_file = config_file;
+        rate_setup.output_directory = batch_setup.output_directory + "/" +
+            aux_stem(config_file.c_str());
+        rate_setup.stats_file = rate_setup.output_directory + "/stats.json";
+        rate_setup.n_threads = n_threads;
+
+        encoders.emplace_back(new encoder(rate_setup));
+
+    }
+
+    /* normalized disparity is coded by the first encoder of each group
+    with the same disparity parameters and copied to the others */
+
+    std::vector<int32_t> disparity_from(n_configs, -1);
+
+    for (int32_t ii = 0; ii < n_configs; ii++) {
+
+        for (int32_t ij = 0; ij < ii; ij++) {
+
+            if (disparity_from.at(ij) < 0 &&
+                encoders.at(ii)->same_normalized_disparity(*encoders.at(ij)))
+            {
+                disparity_from.at(ii) = ij;
+                break;
+            }
+        }
+    }
+
+    for (int32_t ii = 0; ii < n_configs; ii++) {
+
+        encoders.at(ii)->begin_encoding();
+
+        if (disparity_from.at(ii) < 0) {
+            encoders.at(ii)->generate_normalized_disparity();
+        }
+        else {
+            printf("Normalized disparity of %s taken from %s\n",
+                batch_setup.config_files.at(ii).c_str(),
+                batch_setup.config_files.at(disparity_from.at(ii)).c_str());
+
+            encoders.at(ii)->copy_normalized_disparity(
+                *encoders.at(disparity_from.at(ii)));
+        }
+    }
+
+    /* the texture of the rate points is coded concurrently, the threads are
+    divided between them */
+
+    std::vector<std::thread> rate_points;
+
+    for (int32_t ii = 0; ii < n_configs; ii++) {
+
+        encoder *rate_encoder = encoders.at(ii).get();
+
+        rate_encoder->setup.n_threads = std::max(1, n_threads / n_configs);
+
+        rate_points.emplace_back([rate_encoder]() {
+            rate_encoder->generate_texture();
+            rate_encoder->write_bitstream();
+        });
+    }
+
+    for (auto &t : rate_points) {
+        t.join();
+    }
+
+    viewcache_clear();
+
+    share_input_views(false);
+
+}
+
+/* true if the normalized disparity of other is what this encoder would
+code, i.e., the configs differ only in texture parameters */
+bool encoder::same_normalized_disparity(const encoder &other) const {
+
+    if (setup.input_directory != other.setup.input_directory ||
+        n_views_total != other.n_views_total ||
+        nr != other.nr ||
+        nc != other.nc ||
+        depth_median_size != other.depth_median_size)
+    {
+        return false;
+    }
+
+    for (int32_t ii = 0; ii < n_views_total; ii++) {
+
+        const view *SAI = LF + ii;
+        const view *other_SAI = other.LF + ii;
+
+        if (SAI->residual_rate_depth != other_SAI->residual_rate_depth ||
+            SAI->level != other_SAI->level ||
+            SAI->r != other_SAI->r ||
+            SAI->c != other_SAI->c ||
+            SAI->x != other_SAI->x ||
+            SAI->y != other_SAI->y ||
+            SAI->min_inv_d != other_SAI->min_inv_d ||
+            SAI->n_depth_references != other_SAI->n_depth_references)
+        {
+            return false;
+        }
+
+        for (int32_t ij = 0; ij < SAI->n_depth_references; ij++) {
+            if (SAI->depth_references[ij] != other_SAI->depth_references[ij]) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+
+}
+
+/* takes the coded normalized disparity (.pgm and .jp2) of source */
+void encoder::copy_normalized_disparity(const encoder &source) {
+
+    for (int32_t ii = 0; ii < n_views_total; ii++) {
+
+        view *SAI = LF + ii;
+        const view *source_SAI = source.LF + ii;
+
+        aux_copy_file(source_SAI->path_out_pgm, SAI->path_out_pgm);
+
+        if (source_SAI->has_depth_residual) {
+            aux_copy_file(
+                source_SAI->jp2_residual_depth_path_jp2,
+                SAI->jp2_residual_depth_path_jp2);
+        }
+
+        SAI->depth_file_exist = source_SAI->depth_file_exist;
+        SAI->has_depth_residual = source_SAI->has_depth_residual;
+        SAI->real_rate_normpdisp = source_SAI->real_rate_normpdisp;
+
+    }
+
+    /* the copied planes are read from the .pgm files by the texture steps,
+    and released after their last one as if this encoder had coded them */
+
+    int32_t first_texture_step = INT32_MAX;
+
+    for (int32_t ii = 0; ii < n_views_total; ii++) {
+        first_texture_step = std::min(first_texture_step, plan.texture_step.at(ii));
+    }
+
+    for (int32_t ii = 0; ii < n_views_total; ii++) {
+        view_plan_register(plan, first_texture_step, LF + ii, VIEWCACHE_NORMDISP);
+    }
+
 }
 
 void encoder::write_statsfile() {
@@ -156,6 +365,10 @@ void encoder::write_config(string config_json_file_out) {
 
     conf_out["colorspace"] = colorspace_LF;
 
+    if (depth_median_size > 0) {
+        conf_out["depth_median_filter"] = depth_median_size;
+    }
+
     vector<nlohmann::json::object_t> views;
 
     for (int32_t ii = 0; ii < n_views_total; ii++) {
@@ -241,6 +454,23 @@ void encoder::load_config_json(string config_json_file) {
 
     n_seg_iterations = conf["n_seg_iterations"].get<int32_t>();
 
+    /* optional, window size of the median filter on the decoded
+    normalized disparity, 0 for no filtering */
+    if (conf.find("depth_median_filter") != conf.end()) {
+
+        depth_median_size = conf["depth_median_filter"].get<int32_t>();
+
+        if (depth_median_size != 0 &&
+            (depth_median_size < 3 ||
+             depth_median_size > 255 ||
+             depth_median_size % 2 == 0))
+        {
+            printf("depth_median_filter %d, the window size must be odd and between 3 and 255\n",
+                depth_median_size);
+            exit(0);
+        }
+    }
+
     vector<nlohmann::json::object_t> conf_views =
         conf["views"].get<vector<nlohmann::json::object_t>>();
 
@@ -350,45 +580,52 @@ void encoder::load_config_json(string config_json_file) {
 void encoder::forward_warp_texture_references(
     view *LF,
     view *SAI,
-    uint16_t **warped_texture_views,
-    uint16_t **warped_depth_views,
-    float **DispTargs) {
+    warped_references &refs) {
+
+    init_warped_references(
+        SAI->n_references,
+        SAI->nr,
+        SAI->nc,
+        SAI->ncomp,
+        refs);
 
     for (int32_t ij = 0; ij < SAI->n_references; ij++) {
 
         view *ref_view = LF + SAI->references[ij];
 
-        int32_t tmp_w, tmp_r, tmp_ncomp;
+        /* decoded reference from the view cache, the texture stays pinned
+        until the view has been merged */
+        const uint16_t *ref_normdisp =
+            viewcache_acquire(ref_view, VIEWCACHE_NORMDISP);
+        refs.textures[ij] =
+            viewcache_acquire(ref_view, VIEWCACHE_TEXTURE);
 
-        aux_read16PGMPPM(
-            ref_view->path_out_pgm,
-            tmp_w,
-            tmp_r,
-            tmp_ncomp,
-            ref_view->depth);
+        warp_table table;
 
-        aux_read16PGMPPM(
-            ref_view->path_internal_colorspace_out_ppm,
-            tmp_w,
-            tmp_r,
-            tmp_ncomp,
-            ref_view->color);
+        make_warp_table(ref_view, SAI, ref_normdisp, table);
 
-        /* FORWARD warp color */
-        warpView0_to_View1(
+        /* FORWARD warp, winning reference pixels only */
+        warpView0_to_View1_source(
             ref_view,
-            SAI,
-            warped_texture_views[ij],
-            warped_depth_views[ij],
-            DispTargs[ij]);
+            table,
+            ref_normdisp,
+            refs.source.data() + static_cast<size_t>(ij)*refs.nrnc);
 
-        delete[](ref_view->depth);
-        delete[](ref_view->color);
+        if (SAVE_PARTIAL_WARPED_VIEWS) {
 
-        ref_view->depth = nullptr;
-        ref_view->color = nullptr;
+            /* full warped reference for inspection */
+            uint16_t *warped_texture = new uint16_t[SAI->nr*SAI->nc * 3]();
+            uint16_t *warped_depth = new uint16_t[SAI->nr*SAI->nc]();
+            float *DispTarg = new float[SAI->nr*SAI->nc]();
 
-        if (SAVE_PARTIAL_WARPED_VIEWS) {
+            warpView0_to_View1(
+                ref_view,
+                table,
+                refs.textures[ij],
+                ref_normdisp,
+                warped_texture,
+                warped_depth,
+                DispTarg);
 
             char tmp_str[1024];
 
@@ -396,28 +633,41 @@ void encoder::forward_warp_texture_references(
                 setup.output_directory.c_str(), (ref_view)->c, (ref_view)->r,
                 SAI->c, SAI->r);
 
-            aux_write16PGMPPM(tmp_str, SAI->nc, SAI->nr, 3, warped_texture_views[ij]);
+            aux_write16PGMPPM(tmp_str, SAI->nc, SAI->nr, 3, warped_texture);
 
             sprintf(tmp_str, "%s/%03d_%03d_warped_to_%03d_%03d.pgm",
                 setup.output_directory.c_str(), (ref_view)->c, (ref_view)->r,
                 SAI->c, SAI->r);
 
-            aux_write16PGMPPM(tmp_str, SAI->nc, SAI->nr, 1, warped_depth_views[ij]);
+            aux_write16PGMPPM(tmp_str, SAI->nc, SAI->nr, 1, warped_depth);
+
+            delete[](warped_texture);
+            delete[](warped_depth);
+            delete[](DispTarg);
 
         }
 
+        viewcache_unpin(ref_view, VIEWCACHE_NORMDISP);
+
     }
 
+}
+
+void encoder::release_texture_references(
+    view *LF,
+    view *SAI) {
 
+    for (int32_t ij = 0; ij < SAI->n_references; ij++) {
+        viewcache_unpin(LF + SAI->references[ij], VIEWCACHE_TEXTURE);
+    }
 }
 
 void encoder::merge_texture_views(
     view *SAI,
     view *LF,
-    uint16_t **warped_texture_views,
-    float **DispTargs) {
+    const warped_references &refs) {
 
-    initViewW(SAI, DispTargs);
+    initViewW(SAI, refs);
 
     if (SAI->mmode == 0) {
 
@@ -434,19 +684,14 @@ void encoder::merge_texture_views(
         for (int32_t icomp = 0; icomp < SAI->nc_merge; icomp++) {
             getViewMergingLSWeights_icomp(
                 SAI,
-                warped_texture_views,
+                refs,
                 original_color_view,
                 icomp);
         }
 
         delete[](original_color_view);
 
-        for (int32_t icomp = 0; icomp < SAI->nc_merge; icomp++) {
-            mergeWarped_N_icomp(
-                warped_texture_views,
-                SAI,
-                icomp);
-        }
+        mergeWarped_N(refs, SAI, SAI->nc_merge);
 
         /* hole filling for texture*/
         for (int32_t icomp = 0; icomp < SAI->nc_merge; icomp++) {
@@ -472,12 +717,7 @@ void encoder::merge_texture_views(
         }
 
         /* merge color with prediction */
-        for (int32_t icomp = 0; icomp < SAI->nc_merge; icomp++) {
-            mergeWarped_N_icomp(
-                warped_texture_views,
-                SAI,
-                icomp);
-        }
+        mergeWarped_N(refs, SAI, SAI->nc_merge);
 
         /* hole filling for texture*/
         for (int32_t icomp = 0; icomp < nc_merge; icomp++) {
@@ -494,7 +734,7 @@ void encoder::merge_texture_views(
     if (SAI->mmode == 2) {
 
         /*merge with median operator*/
-        mergeMedian_N(warped_texture_views, DispTargs, SAI, nc_merge);
+        mergeMedian_N(refs, SAI, nc_merge);
 
         /* hole filling for texture*/
         for (int32_t icomp = 0; icomp < nc_merge; icomp++) {
@@ -517,191 +757,298 @@ void encoder::generate_normalized_disparity() {
 
     /*the term inverse depth is used interchangeably with normalized disparity */
 
-    int32_t maxh = get_highest_level(LF, n_views_total);
+    code_normalized_disparity_level1();
 
-    /*we DO have to do the last level*/
-    for (int32_t hlevel = 1; hlevel <= maxh; hlevel++) {
+    task_graph graph;
 
-        std::vector< int32_t > view_indices;
+    add_normalized_disparity_tasks(graph, view_plan_dependencies(plan));
 
-        for (int32_t ii = 0; ii < n_views_total; ii++) {
-            if ((LF + ii)->level == hlevel) {
-                view_indices.push_back(ii);
-            }
+    graph.run(setup.n_threads);
+}
+
+/* normalized disparity and texture in one task graph: the texture of a
+view is predicted as soon as the normalized disparities and textures it
+reads are there, so the HEVC coding of the low levels overlaps with the
+disparity prediction of the higher levels */
+void encoder::generate_views() {
+
+    code_normalized_disparity_level1();
+
+    prepare_texture();
+
+    std::vector<std::vector<int32_t>> dependencies =
+        view_plan_dependencies(plan);
+
+    task_graph graph;
+
+    std::vector<int32_t> disparity_task =
+        add_normalized_disparity_tasks(graph, dependencies);
+
+    add_texture_tasks(graph, dependencies, disparity_task);
+
+    graph.run(setup.n_threads);
+
+    finish_texture();
+}
+
+void encoder::code_normalized_disparity_level1() {
+
+    /* the Kakadu runs of the intra coded level-1 views are independent of
+    each other, they are done as one batch before the prediction starts */
+
+    process_pool pool(setup.n_threads);
+
+    for (int32_t ii = 0; ii < n_views_total; ii++) {
+
+        view *SAI = LF + ii;
+
+        if (SAI->level == 1 && SAI->residual_rate_depth > 0) {
+            pool.add([this, SAI]() {
+                code_normalized_disparity_jp2(SAI);
+                return 0;
+            });
         }
+    }
 
-        /*ascending order of view index at a particular level*/
-        sort(view_indices.begin(), view_indices.end());
+    pool.run();
+}
 
-        for (int32_t ii = 0; ii < view_indices.size(); ii++) {
+/* every view is a task which starts once the normalized disparities
+it is predicted from are there, we DO have to do the last level. Returns
+the task of every view. */
+std::vector<int32_t> encoder::add_normalized_disparity_tasks(
+    task_graph &graph,
+    const std::vector<std::vector<int32_t>> &dependencies) {
 
-            view *SAI = LF + view_indices.at(ii);
+    std::vector<int32_t> disparity_task(n_views_total, -1);
 
-            SAI->depth = new uint16_t[SAI->nr * SAI->nc]();
+    const int32_t n_steps = static_cast<int32_t>(plan.steps.size());
 
-            if (hlevel == 1 && SAI->residual_rate_depth > 0) { /*intra coding of inverse depth*/
+    for (int32_t step = 0; step < n_steps; step++) {
 
-                bool depth_file_exist = false;
+        const int32_t ii = plan.steps.at(step).i_order;
 
-                int32_t nc1, nr1, ncomp1;
+        if (plan.normdisp_step.at(ii) != step) {
+            continue; /* texture step */
+        }
 
-                delete[](SAI->depth);
-                SAI->depth = nullptr;
+        view *SAI = LF + ii;
 
-                SAI->depth_file_exist = aux_read16PGMPPM(
-                    SAI->path_input_pgm,
-                    nc1,
-                    nr1,
-                    ncomp1,
-                    SAI->depth);
+        disparity_task.at(ii) = graph.add_task([this, SAI]() {
+            encode_normalized_disparity(SAI);
+        });
 
-                if (SAI->depth_file_exist) {
+        for (int32_t before : dependencies.at(step)) {
+            graph.add_dependency(
+                disparity_task.at(plan.steps.at(before).i_order),
+                disparity_task.at(ii));
+        }
+    }
 
-                    /* ------------------------------
-                    INVERSE DEPTH ENCODING STARTS
-                    -------------------------------*/
+    return disparity_task;
+}
 
-                    printf("Encoding normalized disparity for view %03d_%03d\n", SAI->c, SAI->r);
+/* intra codes the normalized disparity of a level-1 view with Kakadu and
+decodes it to path_out_pgm, called for all such views before the prediction
+of the normalized disparity starts */
+void encoder::code_normalized_disparity_jp2(view *SAI) {
 
-                    /*write inverse depth to .pgm (path SAI->path_out_pgm) */
-                    aux_write16PGMPPM(
-                        SAI->path_out_pgm,
-                        SAI->nc,
-                        SAI->nr,
-                        1,
-                        SAI->depth);
+    int32_t nc1, nr1, ncomp1;
 
-                    delete[](SAI->depth);
-                    SAI->depth = nullptr;
+    SAI->depth = nullptr;
 
-                    char *oparams = kakadu_oparams(
-                        SAI->residual_rate_depth,
-                        "YCbCr"); /*cycc shouldn't matter for single-channel*/
+    SAI->depth_file_exist = aux_read16PGMPPM(
+        SAI->path_input_pgm,
+        nc1,
+        nr1,
+        ncomp1,
+        SAI->depth);
 
-                    char *encoding_parameters = new char[65535]();
-                    sprintf(
-                        encoding_parameters,
-                        "%s",
-                        oparams);
+    if (SAI->depth_file_exist) {
 
-                    encodeKakadu(
-                        SAI->path_out_pgm,
-                        (setup.wasp_kakadu_directory + "/kdu_compress").c_str(),
-                        SAI->jp2_residual_depth_path_jp2,
-                        encoding_parameters,
-                        SAI->residual_rate_depth);
+        /* ------------------------------
+        INVERSE DEPTH ENCODING STARTS
+        -------------------------------*/
 
-                    delete[](encoding_parameters);
-                    /* ------------------------------
-                    INVERSE DEPTH ENCODING ENDS
-                    ------------------------------*/
+        printf("Encoding normalized disparity for view %03d_%03d\n", SAI->c, SAI->r);
 
-                    /* ------------------------------
-                    INVERSE DEPTH DECODING STARTS
-                    ------------------------------*/
+        /*write inverse depth to .pgm (path SAI->path_out_pgm) */
+        aux_write16PGMPPM(
+            SAI->path_out_pgm,
+            SAI->nc,
+            SAI->nr,
+            1,
+            SAI->depth);
 
-                    double bytesndisp = aux_GetFileSize(SAI->jp2_residual_depth_path_jp2);
-                    double bppndisp = 
-                        bytesndisp * 8.0 
-                        / static_cast<double>(SAI->nr) 
-                        / static_cast<double>(SAI->nc);
+        delete[](SAI->depth);
+        SAI->depth = nullptr;
 
-                    SAI->real_rate_normpdisp = bppndisp;
+        char *oparams = kakadu_oparams(
+            SAI->residual_rate_depth,
+            "YCbCr"); /*cycc shouldn't matter for single-channel*/
 
-                    printf("Decoding normalized disparity for view %03d_%03d\n", SAI->c, SAI->r);
+        char *encoding_parameters = new char[65535]();
+        sprintf(
+            encoding_parameters,
+            "%s",
+            oparams);
 
-                    decodeKakadu(
-                        SAI->path_out_pgm,
-                        (setup.wasp_kakadu_directory + "/kdu_expand").c_str(),
-                        SAI->jp2_residual_depth_path_jp2);
+        encodeKakadu(
+            SAI->path_out_pgm,
+            (setup.wasp_kakadu_directory + "/kdu_compress").c_str(),
+            SAI->jp2_residual_depth_path_jp2,
+            encoding_parameters,
+            SAI->residual_rate_depth);
 
-                    /*------------------------------
-                    INVERSE DEPTH DECODING ENDS
-                    ------------------------------*/
+        delete[](encoding_parameters);
+        /* ------------------------------
+        INVERSE DEPTH ENCODING ENDS
+        ------------------------------*/
 
-                    SAI->has_depth_residual = true;
+        /* ------------------------------
+        INVERSE DEPTH DECODING STARTS
+        ------------------------------*/
 
-                    aux_read16PGMPPM(
-                        SAI->path_out_pgm,
-                        nc1,
-                        nr1,
-                        ncomp1,
-                        SAI->depth);
+        double bytesndisp = aux_GetFileSize(SAI->jp2_residual_depth_path_jp2);
+        double bppndisp = 
+            bytesndisp * 8.0 
+            / static_cast<double>(SAI->nr) 
+            / static_cast<double>(SAI->nc);
 
-                    if (MEDFILT_DEPTH) {
+        SAI->real_rate_normpdisp = bppndisp;
 
-                        uint16_t *filtered_depth = medfilt2D(
-                            SAI->depth,
-                            3,
-                            SAI->nr,
-                            SAI->nc);
+        printf("Decoding normalized disparity for view %03d_%03d\n", SAI->c, SAI->r);
 
-                        memcpy(
-                            SAI->depth,
-                            filtered_depth,
-                            sizeof(uint16_t) * SAI->nr * SAI->nc);
+        decodeKakadu(
+            SAI->path_out_pgm,
+            (setup.wasp_kakadu_directory + "/kdu_expand").c_str(),
+            SAI->jp2_residual_depth_path_jp2);
 
-                        delete[](filtered_depth);
+        /*------------------------------
+        INVERSE DEPTH DECODING ENDS
+        ------------------------------*/
 
-                    }
+        SAI->has_depth_residual = true;
 
-                    //aux_write16PGMPPM(
-                    //    SAI->path_out_pgm,
-                    //    nc1,
-                    //    nr1,
-                    //    ncomp1,
-                    //    SAI->depth);
+    }
 
-                }
-            }
-            else { /*prediction only*/
+}
 
-                printf("Predicting normalized disparity for view %03d_%03d\n", SAI->c, SAI->r);
+/* codes (level 1 with depth rate) or predicts the normalized disparity
+of view SAI */
+void encoder::encode_normalized_disparity(view *SAI) {
 
-                /*color array needed in warping function ...*/
-                SAI->color = new uint16_t[SAI->nr * SAI->nc * 3]();
-                /*SAI->depth = new uint16_t[SAI->nr * SAI->nc]();*/
+    SAI->depth = new uint16_t[SAI->nr * SAI->nc]();
 
-                WaSP_predict_depth(SAI, LF);
+    if (SAI->level == 1 && SAI->residual_rate_depth > 0) { /*intra coding of inverse depth*/
 
-                if (MEDFILT_DEPTH) {
+        /* coded and decoded by code_normalized_disparity_jp2() */
 
-                    uint16_t *filtered_depth = medfilt2D(
-                        SAI->depth,
-                        3,
-                        SAI->nr,
-                        SAI->nc);
+        delete[](SAI->depth);
+        SAI->depth = nullptr;
 
-                    memcpy(
-                        SAI->depth,
-                        filtered_depth,
-                        sizeof(uint16_t) * SAI->nr * SAI->nc);
+        if (SAI->depth_file_exist) {
 
-                    delete[](filtered_depth);
+            int32_t nc1, nr1, ncomp1;
 
-                }
+            aux_read16PGMPPM(
+                SAI->path_out_pgm,
+                nc1,
+                nr1,
+                ncomp1,
+                SAI->depth);
+
+            if (depth_median_size > 0) {
 
-                delete[](SAI->color);
-                SAI->color = nullptr;
+                uint16_t *filtered_depth = medfilt2D_uint16(
+                    SAI->depth,
+                    depth_median_size,
+                    SAI->nr,
+                    SAI->nc);
+
+                memcpy(
+                    SAI->depth,
+                    filtered_depth,
+                    sizeof(uint16_t) * SAI->nr * SAI->nc);
+
+                delete[](filtered_depth);
 
             }
 
-            aux_write16PGMPPM(
-                SAI->path_out_pgm,
-                SAI->nc,
+            //aux_write16PGMPPM(
+            //    SAI->path_out_pgm,
+            //    nc1,
+            //    nr1,
+            //    ncomp1,
+            //    SAI->depth);
+
+        }
+    }
+    else { /*prediction only*/
+
+        printf("Predicting normalized disparity for view %03d_%03d\n", SAI->c, SAI->r);
+
+        WaSP_predict_depth(SAI, LF);
+
+        if (depth_median_size > 0) {
+
+            uint16_t *filtered_depth = medfilt2D_uint16(
+                SAI->depth,
+                depth_median_size,
                 SAI->nr,
-                1,
-                SAI->depth);
+                SAI->nc);
 
-            delete[](SAI->depth);
-            SAI->depth = nullptr;
+            memcpy(
+                SAI->depth,
+                filtered_depth,
+                sizeof(uint16_t) * SAI->nr * SAI->nc);
+
+            delete[](filtered_depth);
 
         }
+
     }
+
+    aux_write16PGMPPM(
+        SAI->path_out_pgm,
+        SAI->nc,
+        SAI->nr,
+        1,
+        SAI->depth);
+
+    view_plan_store(
+        plan,
+        plan.normdisp_step.at(SAI->i_order),
+        SAI,
+        VIEWCACHE_NORMDISP,
+        SAI->depth);
+
+    view_plan_step_done(plan, plan.normdisp_step.at(SAI->i_order), LF);
+
+    delete[](SAI->depth);
+    SAI->depth = nullptr;
+
 }
 
 void encoder::generate_texture() {
 
+    prepare_texture();
+
+    task_graph graph;
+
+    add_texture_tasks(
+        graph,
+        view_plan_dependencies(plan),
+        std::vector<int32_t>(n_views_total, -1));
+
+    graph.run(setup.n_threads);
+
+    finish_texture();
+
+}
+
+void encoder::prepare_texture() {
+
     //FILE *tmp;
     //tmp = fopen("C:/Temp/coeffs.data", "wb");
     //int32_t qvalc = (1<<BIT_DEPTH_SPARSE);
@@ -710,29 +1057,38 @@ void encoder::generate_texture() {
 
     maxh = get_highest_level(LF, n_views_total);
 
-    for (int32_t hlevel = 1; hlevel <= maxh; hlevel++) {
+    residual_seqs.resize(maxh + 1);
+    residual_frame.assign(n_views_total, -1);
 
-        printf("\n\tProcessing of hierarchical level: %d\n\n", hlevel);
+    /* final QPs of an earlier run into the same output directory seed the
+    model based QP search */
+    previous_run_QP.assign(maxh + 1, -1);
+    previous_level_QP = -1;
 
-        const int32_t bpc = 10;
+    if (setup.rate_control == RATE_CONTROL_MODEL && aux_exists(setup.stats_file)) {
 
-        int32_t Q = 1;
-        int32_t offset = 0;
+        ifstream ifs(setup.stats_file);
+        nlohmann::json stats = nlohmann::json::parse(ifs, nullptr, false);
 
-        if (hlevel > 1) {
-            Q = 2;
+        if (!stats.is_discarded() && stats.count("views")) {
 
-            offset = (1 << bpc) - 1; /* 10bit images currently */
-        }
+            for (auto &view_stats : stats["views"]) {
 
-        std::vector< int32_t > view_indices;
+                const int32_t level = view_stats["level"].get<int32_t>();
 
-        for (int32_t ii = 0; ii < n_views_total; ii++) {
-            if ((LF + ii)->level == hlevel) {
-                view_indices.push_back(ii);
+                if (level >= 1 && level <= maxh &&
+                    view_stats["real_bpp_texture"].get<double>() > 0)
+                {
+                    previous_run_QP.at(level) =
+                        view_stats["finalQP"].get<int32_t>();
+                }
             }
         }
+    }
 
+    for (int32_t hlevel = 1; hlevel <= maxh; hlevel++) {
+
+        std::vector< int32_t > view_indices = views_at_level(hlevel);
 
         bool texture_residual_for_level = false;
         float textres = 0;
@@ -750,769 +1106,861 @@ void encoder::generate_texture() {
                 (LF + view_indices.at(ii))->residual_rate_color = textres;
             }
         }
+    }
+}
 
-        /*ascending order of view index at level=hlevel*/
-        sort(view_indices.begin(), view_indices.end());
+void encoder::add_texture_tasks(
+    task_graph &graph,
+    const std::vector<std::vector<int32_t>> &dependencies,
+    const std::vector<int32_t> &disparity_task) {
 
-        /* predict (i.e., warp and merge) all views at level=hlevel*/
-        for (int32_t ii = 0; ii < view_indices.size(); ii++) {
+    /* Every view is predicted by a task which starts as soon as the views
+    it references are reconstructed. The texture residuals of a level are
+    coded as one HEVC sequence, so that is a barrier node joining the
+    predictions of the level, and the views of the level are reconstructed
+    after it. */
 
-            view *SAI = LF + view_indices.at(ii);
+    std::vector<int32_t> reconstruct_task(n_views_total, -1);
 
-            printf("Encoding view %03d_%03d\n", SAI->c, SAI->r);
+    int32_t previous_hevc_task = -1;
 
-            SAI->color = new uint16_t[SAI->nr * SAI->nc * 3]();
+    for (int32_t hlevel = 1; hlevel <= maxh; hlevel++) {
 
-            if (SAI->n_references > 0) {
+        std::vector< int32_t > view_indices = views_at_level(hlevel);
 
-                printf("View prediction for view %03d_%03d\n", SAI->c, SAI->r);
+        std::vector<int32_t> predict_tasks;
 
-                uint16_t **warped_texture_views = nullptr;
-                uint16_t **warped_depth_views = nullptr;
-                float **DispTargs = nullptr;
+        for (int32_t ii : view_indices) {
 
-                init_warping_arrays(
-                    SAI->n_references,
-                    warped_texture_views,
-                    warped_depth_views,
-                    DispTargs,
-                    SAI->nr,
-                    SAI->nc,
-                    SAI->ncomp);
-
-                forward_warp_texture_references(
-                    LF,
-                    SAI,
-                    warped_texture_views,
-                    warped_depth_views,
-                    DispTargs);
-
-                merge_texture_views(
-                    SAI,
-                    LF,
-                    warped_texture_views,
-                    DispTargs);
-
-                clean_warping_arrays(
-                    SAI->n_references,
-                    warped_texture_views,
-                    warped_depth_views,
-                    DispTargs);
-
-                if (SAI->Ms > 0 && SAI->NNt > 0) {
-
-                    //aux_write16PGMPPM(
-                    //    SAI->path_internal_colorspace_out_ppm,
-                    //    SAI->nc,
-                    //    SAI->nr,
-                    //    SAI->ncomp,
-                    //    SAI->color);
-
-                    //int tmp_w, tmp_r,tmp_ncomp;
-
-                    //aux_read16PGMPPM(
-                    //    SAI->path_internal_colorspace_out_ppm,
-                    //    tmp_w,
-                    //    tmp_r,
-                    //    tmp_ncomp,
-                    //    SAI->color);
-        
-                    /* OBTAIN SEGMENTATION*/
-                    segmentation seg = makeSegmentation(SAI, n_seg_iterations);
+            view *SAI = LF + ii;
 
-                    uint16_t *original_color_view = read_input_ppm(
-                        SAI->path_input_ppm,
-                        SAI->nr,
-                        SAI->nc,
-                        SAI->ncomp,
-                        bpc,
-                        SAI->colorspace);
+            const int32_t task = graph.add_task([this, SAI]() {
+                predict_texture_view(SAI);
+            });
 
-                    SAI->sparse_filters.clear();
+            /* decoded texture of a reference is there once the reference
+            is reconstructed, normalized disparity once its task is done
+            (or before the graph runs, if it has no task) */
+            for (int32_t before : dependencies.at(plan.texture_step.at(ii))) {
 
-                    /*READ DECODED REFERENCE VIEWS*/
-                    for (int ikr = 0; ikr < SAI->n_references; ikr++) {
+                const int32_t i_ref = plan.steps.at(before).i_order;
 
-                        view *ref_view = LF + SAI->references[ikr];
+                if (plan.texture_step.at(i_ref) == before) {
+                    graph.add_dependency(reconstruct_task.at(i_ref), task);
+                }
+                else if (disparity_task.at(i_ref) >= 0) {
+                    graph.add_dependency(disparity_task.at(i_ref), task);
+                }
+            }
 
-                        int32_t tmp_w, tmp_r, tmp_ncomp;
+            /* the view itself is not touched by both at the same time */
+            if (disparity_task.at(ii) >= 0) {
+                graph.add_dependency(disparity_task.at(ii), task);
+            }
 
-                        aux_read16PGMPPM(
-                            ref_view->path_internal_colorspace_out_ppm,
-                            tmp_w,
-                            tmp_r,
-                            tmp_ncomp,
-                            ref_view->color);
+            predict_tasks.push_back(task);
+        }
 
-                    }
+        const int32_t hevc_task = graph.add_barrier(
+            predict_tasks,
+            [this, hlevel]() {
+                encode_texture_residual(hlevel);
+            });
 
-                    for (int32_t icomp = 0; icomp < SAI->nc_sparse; icomp++) {
+        /* the model based QP search is seeded from the level before */
+        if (setup.rate_control == RATE_CONTROL_MODEL && previous_hevc_task >= 0) {
+            graph.add_dependency(previous_hevc_task, hevc_task);
+        }
 
-                        std::vector<std::vector<uint16_t>> padded_regressors;
+        previous_hevc_task = hevc_task;
 
-                        padded_regressors.push_back(
-                            padArrayUint16_t_vec(
-                                SAI->color + SAI->nr*SAI->nc*icomp,
-                                SAI->nr,
-                                SAI->nc,
-                                SAI->NNt));
+        for (int32_t ii : view_indices) {
 
-                        if (SP_B) {
+            view *SAI = LF + ii;
 
-                            for (int ikr = 0; ikr < SAI->n_references; ikr++) {
+            reconstruct_task.at(ii) = graph.add_task([this, SAI]() {
+                reconstruct_texture_view(SAI);
+            });
 
-                                view *ref_view = LF + SAI->references[ikr];
+            graph.add_dependency(hevc_task, reconstruct_task.at(ii));
+        }
+    }
+}
 
-                                padded_regressors.push_back(
-                                    padArrayUint16_t_vec(
-                                        ref_view->color + SAI->nr*SAI->nc*icomp,
-                                        SAI->nr,
-                                        SAI->nc,
-                                        SAI->NNt));
+void encoder::finish_texture() {
 
-                            }
-                        }
+    for (int32_t hlevel = 1; hlevel <= maxh; hlevel++) {
+        close_decoded_residual_seq(residual_seqs.at(hlevel));
+    }
 
+}
 
-                        
+std::vector<int32_t> encoder::views_at_level(const int32_t hlevel) {
 
-                        std::vector<uint16_t>  padded_icomp_orig = padArrayUint16_t_vec(
-                            original_color_view + SAI->nr*SAI->nc*icomp,
-                            SAI->nr,
-                            SAI->nc,
-                            SAI->NNt);
+    std::vector< int32_t > view_indices;
 
-                        //uint16_t *padded_icomp_orig =
-                        //    padArrayUint16_t(
-                        //        original_color_view + SAI->nr*SAI->nc*icomp,
-                        //        SAI->nr,
-                        //        SAI->nc,
-                        //        SAI->NNt);
+    for (int32_t ii = 0; ii < n_views_total; ii++) {
+        if ((LF + ii)->level == hlevel) {
+            view_indices.push_back(ii);
+        }
+    }
 
-                        for (int ir = 1;
-                            ir <= seg.number_of_regions;
-                            ir++)
-                        {
+    /*ascending order of view index at level=hlevel*/
+    sort(view_indices.begin(), view_indices.end());
 
-                            SAI->sparse_filters.push_back(getGlobalSparseFilter_vec_reg(
-                                padded_icomp_orig.data(),
-                                padded_regressors,
-                                seg.seg,
-                                ir,
-                                SAI->nr + 2 * SAI->NNt,
-                                SAI->nc + 2 * SAI->NNt,
-                                SAI->NNt,
-                                SAI->Ms,
-                                SPARSE_BIAS_TERM,
-                                setup.sparse_subsampling));
-                        }
+    return view_indices;
+}
 
-//                        delete[](padded_icomp_orig);
+/* predicts (i.e., warps and merges) view SAI and obtains its residual */
+void encoder::predict_texture_view(view *SAI) {
 
-                        /* exit(0);*/
-                    }
+    const int32_t bpc = 10;
 
-                    /* APPLY FILTER */
+    int32_t Q = 1;
+    int32_t offset = 0;
 
-                    uint16_t *sp_filtered_image_padded =
-                        new uint16_t[(SAI->nr + 2 * SAI->NNt)*(SAI->nc + 2 * SAI->NNt)*SAI->ncomp]();
+    if (SAI->level > 1) {
+        Q = 2;
 
-                    std::vector<uint16_t> sp_filtered_image(
-                        SAI->color, 
-                        SAI->color+ SAI->nr*SAI->nc*SAI->ncomp );
+        offset = (1 << bpc) - 1; /* 10bit images currently */
+    }
 
-                    int ee = 0;
+    printf("Encoding view %03d_%03d\n", SAI->c, SAI->r);
 
-                    for (int32_t icomp = 0; icomp < nc_sparse; icomp++) {
+    SAI->color = new uint16_t[SAI->nr * SAI->nc * 3]();
 
-                        std::vector<std::vector<uint16_t>> padded_regressors;
+    if (SAI->n_references > 0) {
 
-                        padded_regressors.push_back(
-                            padArrayUint16_t_vec(
-                                SAI->color + SAI->nr*SAI->nc*icomp,
-                                SAI->nr,
-                                SAI->nc,
-                                SAI->NNt));
+        printf("View prediction for view %03d_%03d\n", SAI->c, SAI->r);
 
-                        if (SP_B) {
-                            for (int ikr = 0; ikr < SAI->n_references; ikr++) {
+        warped_references refs;
 
-                                view *ref_view = LF + SAI->references[ikr];
+        forward_warp_texture_references(LF, SAI, refs);
 
-                                padded_regressors.push_back(
-                                    padArrayUint16_t_vec(
-                                        ref_view->color + SAI->nr*SAI->nc*icomp,
-                                        SAI->nr,
-                                        SAI->nc,
-                                        SAI->NNt));
+        merge_texture_views(SAI, LF, refs);
 
-                            }
-                        }
+        release_texture_references(LF, SAI);
 
-                        std::vector<double> filtered_icomp( (SAI->nr + 2 * SAI->NNt)*(SAI->nc + 2 * SAI->NNt), 0);
+        if (SAI->Ms > 0 && SAI->NNt > 0) {
 
-                        for (int ir = 1;
-                            ir <= seg.number_of_regions;
-                            ir++)
-                        {
+            //aux_write16PGMPPM(
+            //    SAI->path_internal_colorspace_out,
+            //    SAI->nc,
+            //    SAI->nr,
+            //    SAI->ncomp,
+            //    SAI->color);
 
-                            quantize_and_reorder_spfilter(
-                                SAI->sparse_filters.at(ee));
+            //int tmp_w, tmp_r,tmp_ncomp;
 
-                            dequantize_and_reorder_spfilter(
-                                SAI->sparse_filters.at(ee));
+            //aux_read16PGMPPM(
+            //    SAI->path_internal_colorspace_out,
+            //    tmp_w,
+            //    tmp_r,
+            //    tmp_ncomp,
+            //    SAI->color);
 
-                            applyGlobalSparseFilter_vec_reg(
-                                padded_regressors,
-                                seg.seg,
-                                ir,
-                                SAI->nr + 2 * SAI->NNt,
-                                SAI->nc + 2 * SAI->NNt,
-                                SAI->Ms,
-                                SAI->NNt,
-                                SPARSE_BIAS_TERM,
-                                SAI->sparse_filters.at(ee).filter_coefficients,
-                                filtered_icomp);
+            /* OBTAIN SEGMENTATION*/
+            segmentation seg = makeSegmentation(SAI, n_seg_iterations);
 
-                            ee = ee + 1;
+            uint16_t *original_color_view = read_input_ppm(
+                SAI->path_input_ppm,
+                SAI->nr,
+                SAI->nc,
+                SAI->ncomp,
+                bpc,
+                SAI->colorspace);
 
-                        }
+            SAI->sparse_filters.clear();
 
-                        for (int32_t iij = 0; iij < (SAI->nr + 2 * SAI->NNt)*(SAI->nc + 2 * SAI->NNt); iij++) {
+            /*DECODED REFERENCE VIEWS FROM THE VIEW CACHE*/
+            std::vector<const uint16_t*> ref_textures;
 
-                            double mmax = static_cast<double>((1 << BIT_DEPTH) - 1);
+            for (int ikr = 0; ikr < SAI->n_references; ikr++) {
 
-                            filtered_icomp[iij] =
-                                clip(filtered_icomp[iij], 0.0, mmax);
+                view *ref_view = LF + SAI->references[ikr];
 
-                            sp_filtered_image_padded[iij + (SAI->nr + 2 * SAI->NNt)*(SAI->nc + 2 * SAI->NNt)*icomp] =
-                                static_cast<uint16_t>(floor(filtered_icomp[iij] + 0.5));
+                ref_textures.push_back(
+                    viewcache_acquire(ref_view, VIEWCACHE_TEXTURE));
 
-                        }
+            }
 
-                        uint16_t *cropped_icomp =
-                            cropImage(sp_filtered_image_padded + (SAI->nr + 2 * SAI->NNt)*(SAI->nc + 2 * SAI->NNt)*icomp,
-                            (SAI->nr + 2 * SAI->NNt),
-                                (SAI->nc + 2 * SAI->NNt),
-                                SAI->NNt);
+            for (int32_t icomp = 0; icomp < SAI->nc_sparse; icomp++) {
 
-                        memcpy(
-                            sp_filtered_image.data() + SAI->nr*SAI->nc*icomp,
-                            cropped_icomp,
-                            sizeof(uint16_t)*SAI->nr*SAI->nc);
+                std::vector<std::vector<uint16_t>> padded_regressors;
 
-                        delete[](cropped_icomp);
+                padded_regressors.push_back(
+                    padArrayUint16_t_vec(
+                        SAI->color + SAI->nr*SAI->nc*icomp,
+                        SAI->nr,
+                        SAI->nc,
+                        SAI->NNt));
+
+                if (SP_B) {
+
+                    for (int ikr = 0; ikr < SAI->n_references; ikr++) {
+
+                        padded_regressors.push_back(
+                            padArrayUint16_t_vec(
+                                ref_textures.at(ikr) + SAI->nr*SAI->nc*icomp,
+                                SAI->nr,
+                                SAI->nc,
+                                SAI->NNt));
 
                     }
+                }
 
-                    SAI->number_of_sp_filters = SAI->sparse_filters.size();
 
-                    /* CLEAN */
 
-                    for (int ikr = 0; ikr < SAI->n_references; ikr++) {
 
-                        view *ref_view = LF + SAI->references[ikr];
+                std::vector<uint16_t>  padded_icomp_orig = padArrayUint16_t_vec(
+                    original_color_view + SAI->nr*SAI->nc*icomp,
+                    SAI->nr,
+                    SAI->nc,
+                    SAI->NNt);
+
+                //uint16_t *padded_icomp_orig =
+                //    padArrayUint16_t(
+                //        original_color_view + SAI->nr*SAI->nc*icomp,
+                //        SAI->nr,
+                //        SAI->nc,
+                //        SAI->NNt);
+
+                for (int ir = 1;
+                    ir <= seg.number_of_regions;
+                    ir++)
+                {
+
+                    SAI->sparse_filters.push_back(getGlobalSparseFilter_vec_reg(
+                        padded_icomp_orig.data(),
+                        padded_regressors,
+                        seg.seg,
+                        ir,
+                        SAI->nr + 2 * SAI->NNt,
+                        SAI->nc + 2 * SAI->NNt,
+                        SAI->NNt,
+                        SAI->Ms,
+                        SPARSE_BIAS_TERM,
+                        setup.sparse_subsampling));
+                }
 
-                        delete[](ref_view->color);
-                        ref_view->color = nullptr;
+//                        delete[](padded_icomp_orig);
 
-                    }
+                /* exit(0);*/
+            }
+
+            /* APPLY FILTER */
 
-                    delete[](sp_filtered_image_padded);
+            uint16_t *sp_filtered_image_padded =
+                new uint16_t[(SAI->nr + 2 * SAI->NNt)*(SAI->nc + 2 * SAI->NNt)*SAI->ncomp]();
 
-                    //double psnr_without_sparse = PSNR(
-                    //    original_color_view,
-                    //    SAI->color,
-                    //    SAI->nr,
-                    //    SAI->nc,
-                    //    nc_sparse,
-                    //    (1 << 10) - 1);
+            std::vector<uint16_t> sp_filtered_image(
+                SAI->color, 
+                SAI->color+ SAI->nr*SAI->nc*SAI->ncomp );
 
-                    //double psnr_with_sparse = PSNR(
-                    //    original_color_view,
-                    //    sp_filtered_image.data(),
-                    //    SAI->nr,
-                    //    SAI->nc,
-                    //    nc_sparse,
-                    //    (1 << bpc) - 1);
+            int ee = 0;
 
-                    //if (psnr_with_sparse > psnr_without_sparse) {
+            for (int32_t icomp = 0; icomp < nc_sparse; icomp++) {
 
-                        memcpy(
-                            SAI->color,
-                            sp_filtered_image.data(),
-                            sizeof(uint16_t)*SAI->nr*SAI->nc*SAI->ncomp);
+                std::vector<std::vector<uint16_t>> padded_regressors;
 
-                        SAI->use_global_sparse = true;
+                padded_regressors.push_back(
+                    padArrayUint16_t_vec(
+                        SAI->color + SAI->nr*SAI->nc*icomp,
+                        SAI->nr,
+                        SAI->nc,
+                        SAI->NNt));
 
-                    //}
+                if (SP_B) {
+                    for (int ikr = 0; ikr < SAI->n_references; ikr++) {
 
-                    delete[](original_color_view);
+                        padded_regressors.push_back(
+                            padArrayUint16_t_vec(
+                                ref_textures.at(ikr) + SAI->nr*SAI->nc*icomp,
+                                SAI->nr,
+                                SAI->nc,
+                                SAI->NNt));
 
+                    }
                 }
 
-            }
+                std::vector<double> filtered_icomp( (SAI->nr + 2 * SAI->NNt)*(SAI->nc + 2 * SAI->NNt), 0);
 
-            /* write raw prediction to .ppm */
+                for (int ir = 1;
+                    ir <= seg.number_of_regions;
+                    ir++)
+                {
 
-            aux_write16PGMPPM(
-                SAI->path_raw_prediction_at_encoder_ppm,
-                SAI->nc,
-                SAI->nr,
-                3,
-                SAI->color);
+                    quantize_and_reorder_spfilter(
+                        SAI->sparse_filters.at(ee));
 
-            delete[](SAI->color);
-            SAI->color = nullptr;
+                    dequantize_and_reorder_spfilter(
+                        SAI->sparse_filters.at(ee));
 
-        }
+                    applyGlobalSparseFilter_vec_reg(
+                        padded_regressors,
+                        seg.seg,
+                        ir,
+                        SAI->nr + 2 * SAI->NNt,
+                        SAI->nc + 2 * SAI->NNt,
+                        SAI->Ms,
+                        SAI->NNt,
+                        SPARSE_BIAS_TERM,
+                        SAI->sparse_filters.at(ee).filter_coefficients,
+                        filtered_icomp);
 
-        /* get residue for all views at level=hlevel,
-        AFTER THIS LOOP,
-        YOU CAN FIND ALL RESIDUAL IMAGES IN directories "outputdir/residual/RAW/<level>"
-        */
-        for (int32_t ii = 0; ii < view_indices.size(); ii++) {
+                    ee = ee + 1;
 
-            view *SAI = LF + view_indices.at(ii);
+                }
 
-            if (SAI->residual_rate_color > 0) {
+                for (int32_t iij = 0; iij < (SAI->nr + 2 * SAI->NNt)*(SAI->nc + 2 * SAI->NNt); iij++) {
 
-                printf("Obtaining texture residual for view %03d_%03d\n", SAI->c, SAI->r);
+                    double mmax = static_cast<double>((1 << BIT_DEPTH) - 1);
 
-                aux_read16PGMPPM(
-                    SAI->path_raw_prediction_at_encoder_ppm,
-                    SAI->nc,
-                    SAI->nr,
-                    SAI->ncomp,
-                    SAI->color);
+                    filtered_icomp[iij] =
+                        clip(filtered_icomp[iij], 0.0, mmax);
 
-                uint16_t *original_color_view = read_input_ppm(
-                    SAI->path_input_ppm,
-                    SAI->nr,
-                    SAI->nc,
-                    SAI->ncomp,
-                    bpc,
-                    SAI->colorspace);
+                    sp_filtered_image_padded[iij + (SAI->nr + 2 * SAI->NNt)*(SAI->nc + 2 * SAI->NNt)*icomp] =
+                        static_cast<uint16_t>(floor(filtered_icomp[iij] + 0.5));
 
-                double *residual_image_double = get_residual(
-                    original_color_view,
-                    SAI->color,
-                    SAI->nr,
-                    SAI->nc,
-                    3);
+                }
 
-                delete[](original_color_view);
+                uint16_t *cropped_icomp =
+                    cropImage(sp_filtered_image_padded + (SAI->nr + 2 * SAI->NNt)*(SAI->nc + 2 * SAI->NNt)*icomp,
+                    (SAI->nr + 2 * SAI->NNt),
+                        (SAI->nc + 2 * SAI->NNt),
+                        SAI->NNt);
 
-                SAI->residual_image = quantize_residual(
-                    residual_image_double,
-                    SAI->nr,
-                    SAI->nc,
-                    SAI->ncomp,
-                    bpc,
-                    Q,
-                    offset);
+                memcpy(
+                    sp_filtered_image.data() + SAI->nr*SAI->nc*icomp,
+                    cropped_icomp,
+                    sizeof(uint16_t)*SAI->nr*SAI->nc);
 
-                delete[](residual_image_double);
+                delete[](cropped_icomp);
 
-                /* write raw quantized residual to .ppm */
+            }
 
-                aux_write16PGMPPM(
-                    SAI->path_raw_texture_residual_at_encoder_ppm,
-                    SAI->nc,
-                    SAI->nr,
-                    SAI->ncomp,
-                    SAI->residual_image);
+            SAI->number_of_sp_filters = SAI->sparse_filters.size();
 
-                delete[](SAI->color);
-                SAI->color = nullptr;
-                delete[](SAI->residual_image);
-                SAI->residual_image = nullptr;
+            /* CLEAN */
+
+            for (int ikr = 0; ikr < SAI->n_references; ikr++) {
+
+                view *ref_view = LF + SAI->references[ikr];
+
+                viewcache_unpin(ref_view, VIEWCACHE_TEXTURE);
 
             }
 
-        }
+            delete[](sp_filtered_image_padded);
 
-        /* encode residual images using HEVC for all views at level=hlevel
-        which have texture residual rate >0,
-        here we can substitute HEVC with MuLE etc*/
+            //double psnr_without_sparse = PSNR(
+            //    original_color_view,
+            //    SAI->color,
+            //    SAI->nr,
+            //    SAI->nc,
+            //    nc_sparse,
+            //    (1 << 10) - 1);
 
+            //double psnr_with_sparse = PSNR(
+            //    original_color_view,
+            //    sp_filtered_image.data(),
+            //    SAI->nr,
+            //    SAI->nc,
+            //    nc_sparse,
+            //    (1 << bpc) - 1);
 
-        /*make scan order "serpent" in vector "hevc_i_order" */
-        if (texture_residual_for_level) {
+            //if (psnr_with_sparse > psnr_without_sparse) {
 
-            std::vector<int32_t> hevc_i_order =
-                getScanOrder(LF, view_indices);
+                memcpy(
+                    SAI->color,
+                    sp_filtered_image.data(),
+                    sizeof(uint16_t)*SAI->nr*SAI->nc*SAI->ncomp);
 
-            std::vector< std::vector<uint16_t>> YUV_444_SEQ;
+                SAI->use_global_sparse = true;
 
-            /*padding to mincusize*/
+            //}
 
-            const int32_t mincusize = 8;
+            delete[](original_color_view);
 
-           // const int32_t VERP = (mincusize - LF->nr%mincusize);
-            //const int32_t HORP = (mincusize - LF->nc%mincusize);
-            const int32_t VERP = mincusize*((LF->nr % mincusize) ? 
-                LF->nr / mincusize + 1 : LF->nr / mincusize )- LF->nr;
-            const int32_t HORP = mincusize*((LF->nc % mincusize) ? 
-                LF->nc / mincusize + 1 : LF->nc / mincusize) - LF->nc;
+        }
 
-            int32_t nr1 = LF->nr + VERP;
-            int32_t nc1 = LF->nc + HORP;
+    }
 
-            for (int32_t ii = 0; ii < view_indices.size(); ii++) {
+    /* reference views no longer needed are released */
+    view_plan_step_done(plan, plan.texture_step.at(SAI->i_order), LF);
 
-                view *SAI = LF + hevc_i_order.at(ii);
+    /* write raw prediction to .ppm */
 
-                /* ------------------------------
-                TEXTURE RESIDUAL ENCODING STARTS
-                ------------------------------*/
+    aux_write16planar(
+        SAI->path_raw_prediction_at_encoder,
+        SAI->nc,
+        SAI->nr,
+        3,
+        SAI->color);
 
-                printf("Encoding texture residual for view %03d_%03d\n", SAI->c, SAI->r);
+    /* get residue, written to "outputdir/residual/RAW/<level>" */
+    if (SAI->residual_rate_color > 0) {
 
-                aux_read16PGMPPM(
-                    SAI->path_raw_texture_residual_at_encoder_ppm,
-                    SAI->nc,
-                    SAI->nr,
-                    SAI->ncomp,
-                    SAI->residual_image);
+        printf("Obtaining texture residual for view %03d_%03d\n", SAI->c, SAI->r);
 
-                std::vector<uint16_t> paddedi = padArrayUint16_t_for_HM(
-                    SAI->residual_image,
-                    SAI->nr,
-                    SAI->nc,
-                    SAI->ncomp,
-                    HORP,
-                    VERP);
+        uint16_t *original_color_view = read_input_ppm(
+            SAI->path_input_ppm,
+            SAI->nr,
+            SAI->nc,
+            SAI->ncomp,
+            bpc,
+            SAI->colorspace);
 
-                YUV_444_SEQ.push_back(paddedi);
+        double *residual_image_double = get_residual(
+            original_color_view,
+            SAI->color,
+            SAI->nr,
+            SAI->nc,
+            3);
 
-                delete[](SAI->residual_image);
-                SAI->residual_image = nullptr;
+        delete[](original_color_view);
 
-                SAI->has_color_residual = true;
+        SAI->residual_image = quantize_residual(
+            residual_image_double,
+            SAI->nr,
+            SAI->nc,
+            SAI->ncomp,
+            bpc,
+            Q,
+            offset);
 
-            }
+        delete[](residual_image_double);
 
-            view *SAI0 = LF + hevc_i_order.at(0);
+        /* write raw quantized residual to .ppm */
 
-            writeYUV444_seq_to_disk(
-                YUV_444_SEQ,
-                SAI0->encoder_raw_output_444);
+        aux_write16planar(
+            SAI->path_raw_texture_residual_at_encoder,
+            SAI->nc,
+            SAI->nr,
+            SAI->ncomp,
+            SAI->residual_image);
 
-            /* ------------------------------
-            TEXTURE RESIDUAL ENCODING STARTS
-            ------------------------------*/
+        delete[](SAI->residual_image);
+        SAI->residual_image = nullptr;
 
-            /* encode HM, YUV444 -> .hevc (any YUV format) */
+    }
 
-           
+    delete[](SAI->color);
+    SAI->color = nullptr;
 
-            long(*hevc_encoder)(
-                const char *,
-                const char *,
-                YUV_FORMAT,
-                const int32_t,
-                const int32_t,
-                const int32_t,
-                const int32_t,
-                const char *,
-                const char *,
-                const char *,
-                const int32_t,
-                const int32_t);
+}
 
-            /*not used by HM*/
-            int32_t gopsize = 0;
-            int32_t iperiod = 1;
+/* encodes residual images using HEVC for all views at level=hlevel
+which have texture residual rate >0,
+here we can substitute HEVC with MuLE etc*/
+void encoder::encode_texture_residual(const int32_t hlevel) {
 
-            if (USE_KVAZAAR) {
+    printf("\n\tProcessing of hierarchical level: %d\n\n", hlevel);
 
-                hevc_encoder = &encodeKVAZAAR;
+    std::vector< int32_t > view_indices = views_at_level(hlevel);
 
-                /*super cumbersome YUV transform to suite kvazaar ...*/
+    const int32_t n_level_views = static_cast<int32_t>(view_indices.size());
 
-                if ( YUVTYPE==YUV420 || (SAI0->level<2 && nc_color_ref>1) )
-                {
+    bool texture_residual_for_level = false;
+    for (int32_t ii = 0; ii < n_level_views; ii++) {
+        if ((LF + view_indices.at(ii))->has_color_residual) {
+            texture_residual_for_level = true;
+            break;
+        }
+    }
 
-                    std::vector<std::vector<uint16_t>> yuv420_seq = convertYUVseqTo420(
-                        SAI0->encoder_raw_output_444,
-                        YUV444,
-                        nr1,
-                        nc1,
-                        YUV_444_SEQ.size());
+    if (!texture_residual_for_level) {
+        return;
+    }
 
-                    writeYUV420_seq_to_disk(
-                        yuv420_seq,
-                        SAI0->encoder_raw_output_444);
+    /*make scan order "serpent" in vector "hevc_i_order" */
+    std::vector<int32_t> hevc_i_order =
+        getScanOrder(LF, view_indices);
 
-                }
-                else if( nc_color_ref<2 || (SAI0->level>1 && YUVTYPE==YUV400) )
-                {
+    std::vector< std::vector<uint16_t>> YUV_444_SEQ;
 
-                    std::vector<std::vector<uint16_t>> yuv400_seq = convertYUVseqTo400(
-                        SAI0->encoder_raw_output_444,
-                        YUV444,
-                        nr1,
-                        nc1,
-                        YUV_444_SEQ.size());
+    /*padding to mincusize*/
 
-                    writeYUV400_seq_to_disk(
-                        yuv400_seq,
-                        SAI0->encoder_raw_output_444);
+    const int32_t mincusize = 8;
 
-                }
-                if (SAI0->level > 1)
-                {
-                    //gopsize = 8;
-                    //iperiod = 8;
-                }
+   // const int32_t VERP = (mincusize - LF->nr%mincusize);
+    //const int32_t HORP = (mincusize - LF->nc%mincusize);
+    const int32_t VERP = mincusize*((LF->nr % mincusize) ? 
+        LF->nr / mincusize + 1 : LF->nr / mincusize )- LF->nr;
+    const int32_t HORP = mincusize*((LF->nc % mincusize) ? 
+        LF->nc / mincusize + 1 : LF->nc / mincusize) - LF->nc;
 
-            }
-            else
-            {
-                hevc_encoder = &encodeHM;
-            }
+    int32_t nr1 = LF->nr + VERP;
+    int32_t nc1 = LF->nc + HORP;
 
-            int32_t QPfinal = 0;
+    for (int32_t ii = 0; ii < n_level_views; ii++) {
 
-            if (SAI0->preset_QP < 0) {
+        view *SAI = LF + hevc_i_order.at(ii);
 
-                std::vector<double> bpps;
-                std::vector<int32_t> QPs;
+        /* ------------------------------
+        TEXTURE RESIDUAL ENCODING STARTS
+        ------------------------------*/
 
-                int32_t QPstep = 3;
+        printf("Encoding texture residual for view %03d_%03d\n", SAI->c, SAI->r);
 
-                for (int32_t QP = 0; QP <= 51; QP += QPstep) {
+        /* padded straight from the mapped residual file */
 
-                    //for (int32_t QP = 25; QP = 25; QP=25 ) {
-                    long bytes_hevc = hevc_encoder(
-                        SAI0->encoder_raw_output_444,
-                        SAI0->hevc_texture,
-                        hlevel > 1 ? YUVTYPE: (nc_color_ref>1 ? YUV444 : YUV400),
-                        QP,
-                        YUV_444_SEQ.size(),
-                        nc1,
-                        nr1,
-                        SAI0->decoder_raw_output_YUV,
-                        setup.hm_encoder.c_str(),
-                        setup.hm_cfg.c_str(),
-                        gopsize,
-                        iperiod); /*transpose for nr,nc*/
+        aux_mapped_file residual_file;
+        const uint16_t *residual_image;
 
-                    double bpphevc =
-                        double(bytes_hevc * 8) / double((LF->nr*LF->nc*view_indices.size()));
+        aux_map16planar(
+            SAI->path_raw_texture_residual_at_encoder,
+            SAI->nc,
+            SAI->nr,
+            SAI->ncomp,
+            residual_file,
+            residual_image);
 
-                    printf("\nQP=%d\tbpp=\t%f\n", QP, bpphevc);
+        std::vector<uint16_t> paddedi = padArrayUint16_t_for_HM(
+            residual_image,
+            SAI->nr,
+            SAI->nc,
+            SAI->ncomp,
+            HORP,
+            VERP);
 
-                    bpps.push_back(bpphevc);
-                    QPs.push_back(QP);
+        YUV_444_SEQ.push_back(paddedi);
 
-                    if (*(bpps.end() - 1) < SAI0->residual_rate_color) {
-                        break;
-                    }
+        aux_unmap_file(residual_file);
 
-                }
+        SAI->has_color_residual = true;
 
-                SAI0->bpp_range = std::vector<double>(bpps);
-                SAI0->QP_range = std::vector<int32_t>(QPs);
+    }
 
-                /*use first one*/
-                if (bpps.size() == 1) {
-                    QPfinal = QPs.at(0);
-                }
-                /*use last one*/
-                else if (*(bpps.end() - 1) > SAI0->residual_rate_color) {
-                    QPfinal = *(QPs.end() - 1);
-                }
-                /*interpolate*/
-                else {
+    view *SAI0 = LF + hevc_i_order.at(0);
 
-                    double dx = *(bpps.end() - 1) - *(bpps.end() - 2);
-                    double dy = QPstep;// *(QPs.end() - 1) - *(QPs.end() - 2);
+    writeYUV444_seq_to_disk(
+        YUV_444_SEQ,
+        SAI0->encoder_raw_output_444);
 
-                    double diffx = SAI0->residual_rate_color - *(bpps.end() - 2);
+    /* ------------------------------
+    TEXTURE RESIDUAL ENCODING STARTS
+    ------------------------------*/
 
-                    QPfinal = round(double(*(QPs.end() - 2) + diffx*(dy / dx)));
+    /* encode HM, YUV444 -> .hevc (any YUV format) */
 
-                }
-            }
-            else {
-                QPfinal = SAI0->preset_QP;
-            }
 
-            long bytes_hevc = hevc_encoder(
+
+    long(*hevc_encoder)(
+        const char *,
+        const char *,
+        YUV_FORMAT,
+        const int32_t,
+        const int32_t,
+        const int32_t,
+        const int32_t,
+        const char *,
+        const char *,
+        const char *,
+        const int32_t,
+        const int32_t);
+
+    /*not used by HM*/
+    int32_t gopsize = 0;
+    int32_t iperiod = 1;
+
+    if (USE_KVAZAAR) {
+
+        hevc_encoder = &encodeKVAZAAR;
+
+        /*super cumbersome YUV transform to suite kvazaar ...*/
+
+        if ( YUVTYPE==YUV420 || (SAI0->level<2 && nc_color_ref>1) )
+        {
+
+            std::vector<std::vector<uint16_t>> yuv420_seq = convertYUVseqTo420(
                 SAI0->encoder_raw_output_444,
-                SAI0->hevc_texture,
-                hlevel>1 ? YUVTYPE : (nc_color_ref>1 ? YUV444 : YUV400),
-                QPfinal,
-                YUV_444_SEQ.size(),
+                YUV444,
+                nr1,
                 nc1,
+                YUV_444_SEQ.size());
+
+            writeYUV420_seq_to_disk(
+                yuv420_seq,
+                SAI0->encoder_raw_output_444);
+
+        }
+        else if( nc_color_ref<2 || (SAI0->level>1 && YUVTYPE==YUV400) )
+        {
+
+            std::vector<std::vector<uint16_t>> yuv400_seq = convertYUVseqTo400(
+                SAI0->encoder_raw_output_444,
+                YUV444,
                 nr1,
-                SAI0->decoder_raw_output_YUV,
-                setup.hm_encoder.c_str(),
-                setup.hm_cfg.c_str(),
-                gopsize,
-                iperiod); /*transpose for nr,nc*/
+                nc1,
+                YUV_444_SEQ.size());
 
-            double bpphevc =
-                double(bytes_hevc * 8) / double((LF->nr*LF->nc*view_indices.size()));
+            writeYUV400_seq_to_disk(
+                yuv400_seq,
+                SAI0->encoder_raw_output_444);
 
-            printf("\nFinal QP=%d\tbpp=\t%f\n", QPfinal, bpphevc);
+        }
+        if (SAI0->level > 1)
+        {
+            //gopsize = 8;
+            //iperiod = 8;
+        }
 
-            for (int32_t ii = 0; ii < view_indices.size(); ii++) {
+    }
+    else
+    {
+        hevc_encoder = &encodeHM;
+    }
+
+    const YUV_FORMAT hevc_format =
+        hlevel > 1 ? YUVTYPE : (nc_color_ref>1 ? YUV444 : YUV400);
+
+    /* rate of the level coded at QP, files given by the rate control */
+    qp_probe probe = [&](
+        const int32_t QP,
+        const std::string &hevc_file,
+        const std::string &yuv_file) {
+
+        long bytes_hevc = hevc_encoder(
+            SAI0->encoder_raw_output_444,
+            hevc_file.c_str(),
+            hevc_format,
+            QP,
+            YUV_444_SEQ.size(),
+            nc1,
+            nr1,
+            yuv_file.c_str(),
+            setup.hm_encoder.c_str(),
+            setup.hm_cfg.c_str(),
+            gopsize,
+            iperiod); /*transpose for nr,nc*/
 
-                view *SAI = LF + hevc_i_order.at(ii);
+        double bpphevc =
+            double(bytes_hevc * 8) / double((LF->nr*LF->nc*view_indices.size()));
 
-                SAI->finalQP = QPfinal;
-                SAI->real_rate_texture = bpphevc;
-                SAI->QP_range = SAI0->QP_range;
-                SAI->bpp_range = SAI0->bpp_range;
+        printf("\nQP=%d\tbpp=\t%f\n", QP, bpphevc);
 
-            }
+        return bpphevc;
+
+    };
+
+    int32_t QPfinal = 0;
+
+    std::string hevc_at_QPfinal;
+
+    if (SAI0->preset_QP < 0) {
 
-            /* ------------------------------
-            TEXTURE RESIDUAL ENCODING ENDS
-            ------------------------------*/
+        qp_search_result search;
 
+        if (setup.rate_control == RATE_CONTROL_MODEL) {
 
-            /* ------------------------------
-            TEXTURE RESIDUAL DECODING STARTS
-            ------------------------------*/
+            /* QP of the same level in the previous run, else of the level
+            coded before this one */
+            int32_t seed = previous_run_QP.at(hlevel);
 
-            /* decode HM, .hevc (any YUV format) -> (any YUV format)  */
+            if (seed < 0) {
+                seed = previous_level_QP;
+            }
 
-            int32_t status = decodeHM(
+            search = search_QP_model(
+                probe,
+                SAI0->residual_rate_color,
+                SAI0->hevc_texture,
+                SAI0->decoder_raw_output_YUV,
+                seed);
+        }
+        else if (setup.rate_control == RATE_CONTROL_PARALLEL) {
+            search = search_QP_parallel(
+                probe,
+                SAI0->residual_rate_color,
                 SAI0->hevc_texture,
                 SAI0->decoder_raw_output_YUV,
-                setup.hm_decoder.c_str());
+                setup.n_threads);
+        }
+        else {
+            search = search_QP_linear(
+                probe,
+                SAI0->residual_rate_color,
+                SAI0->hevc_texture,
+                SAI0->decoder_raw_output_YUV);
+        }
 
-            /*convert (any YUV format) -> YUV444 */
+        SAI0->bpp_range = search.bpps;
+        SAI0->QP_range = search.QPs;
 
-            std::vector<std::vector<uint16_t>> YUV444_dec = convertYUVseqTo444(
-                SAI0->decoder_raw_output_YUV,
-                hlevel>1 ? YUVTYPE : (nc_color_ref>1 ? YUV444 : YUV400),
-                nr1,
-                nc1,
-                hevc_i_order.size());
+        QPfinal = search.QPfinal;
+        hevc_at_QPfinal = search.hevc_at_QPfinal;
 
-            /* write PPM back to correct places, YUV444 -> .ppm */
+    }
+    else {
+        QPfinal = SAI0->preset_QP;
+    }
 
-            for (int32_t ii = 0; ii < view_indices.size(); ii++) {
+    long bytes_hevc = 0;
 
-                view *SAI = LF + hevc_i_order.at(ii);
+    if (hevc_at_QPfinal.length() > 0) {
 
-                uint16_t *cropped = cropImage_for_HM(
-                    YUV444_dec.at(ii).data(),
-                    nr1,
-                    nc1,
-                    SAI->ncomp,
-                    HORP,
-                    VERP);
+        /* the search already coded the level at QPfinal */
 
-                aux_write16PGMPPM(
-                    SAI->path_raw_texture_residual_at_decoder_ppm,
-                    SAI->nc,
-                    SAI->nr,
-                    SAI->ncomp,
-                    cropped);
+        remove(SAI0->hevc_texture);
+        rename(hevc_at_QPfinal.c_str(), SAI0->hevc_texture);
 
-                SAI->has_color_residual = true;
+        bytes_hevc = aux_GetFileSize(SAI0->hevc_texture);
 
-                delete[](cropped);
+    }
+    else {
+
+        bytes_hevc = hevc_encoder(
+            SAI0->encoder_raw_output_444,
+            SAI0->hevc_texture,
+            hevc_format,
+            QPfinal,
+            YUV_444_SEQ.size(),
+            nc1,
+            nr1,
+            SAI0->decoder_raw_output_YUV,
+            setup.hm_encoder.c_str(),
+            setup.hm_cfg.c_str(),
+            gopsize,
+            iperiod); /*transpose for nr,nc*/
 
-            }
+    }
 
-            /* ------------------------------
-            TEXTURE RESIDUAL DECODING ENDS
-            ------------------------------*/
-        }
+    double bpphevc =
+        double(bytes_hevc * 8) / double((LF->nr*LF->nc*view_indices.size()));
 
+    printf("\nFinal QP=%d\tbpp=\t%f\n", QPfinal, bpphevc);
 
+    /* only the model based search reads it, and only there are the
+    levels ordered */
+    if (setup.rate_control == RATE_CONTROL_MODEL) {
+        previous_level_QP = QPfinal;
+    }
 
-        for (int32_t ii = 0; ii < view_indices.size(); ii++) {
+    for (int32_t ii = 0; ii < n_level_views; ii++) {
 
-            view *SAI = LF + view_indices.at(ii);
+        view *SAI = LF + hevc_i_order.at(ii);
 
-            aux_read16PGMPPM(
-                SAI->path_raw_prediction_at_encoder_ppm,
-                SAI->nc,
-                SAI->nr,
-                SAI->ncomp,
-                SAI->color);
+        SAI->finalQP = QPfinal;
+        SAI->real_rate_texture = bpphevc;
+        SAI->QP_range = SAI0->QP_range;
+        SAI->bpp_range = SAI0->bpp_range;
 
-            if (SAI->has_color_residual) {
+    }
 
-                printf("Decoding texture residual for view %03d_%03d\n", SAI->c, SAI->r);
+    /* ------------------------------
+    TEXTURE RESIDUAL ENCODING ENDS
+    ------------------------------*/
 
-                uint16_t *decoded_residual_image;
 
-                aux_read16PGMPPM(
-                    SAI->path_raw_texture_residual_at_decoder_ppm,
-                    SAI->nc,
-                    SAI->nr,
-                    SAI->ncomp,
-                    decoded_residual_image);
+    /* ------------------------------
+    TEXTURE RESIDUAL DECODING STARTS
+    ------------------------------*/
 
-                double *residual = dequantize_residual(
-                    decoded_residual_image,
-                    SAI->nr,
-                    SAI->nc,
-                    SAI->ncomp,
-                    bpc,
-                    Q,
-                    offset);
+    /* decode HM, .hevc (any YUV format) -> (any YUV format)  */
 
-                uint16_t *corrected = apply_residual(
-                    SAI->color,
-                    residual,
-                    SAI->nr,
-                    SAI->nc,
-                    SAI->ncomp,
-                    bpc);
+    int32_t status = decodeHM(
+        SAI0->hevc_texture,
+        SAI0->decoder_raw_output_YUV,
+        setup.hm_decoder.c_str());
 
-                /* update SAI->color to contain
-                corrected (i.e., prediction + residual) version*/
-                memcpy(
-                    SAI->color,
-                    corrected,
-                    sizeof(uint16_t)*SAI->nr*SAI->nc*SAI->ncomp);
+    /* residuals are applied from the decoded sequence,
+    (any YUV format) -> padded YUV444 frame views */
 
-                delete[](residual);
-                delete[](corrected);
-                delete[](decoded_residual_image);
+    if (!open_decoded_residual_seq(
+        SAI0->decoder_raw_output_YUV,
+        hlevel>1 ? YUVTYPE : (nc_color_ref>1 ? YUV444 : YUV400),
+        nr1,
+        nc1,
+        static_cast<int32_t>(hevc_i_order.size()),
+        residual_seqs.at(hlevel)))
+    {
+        exit(0);
+    }
 
-            }
+    for (int32_t ii = 0; ii < n_level_views; ii++) {
 
-            /*WRITE result to disk*/
+        view *SAI = LF + hevc_i_order.at(ii);
 
-            /*writing .ppm in internal colorspace*/
-            aux_write16PGMPPM(
-                SAI->path_internal_colorspace_out_ppm,
-                SAI->nc,
-                SAI->nr,
-                SAI->ncomp,
-                SAI->color);
-
-            /*writing .ppm in output colorspace,
-            If we only encode luminance, we have luminance as the first
-            component of the .ppm file !
-            */
-            write_output_ppm(
-                SAI->color,
-                SAI->path_out_ppm,
-                SAI->nr,
-                SAI->nc,
-                nc_color_ref,
-                bpc,
-                SAI->colorspace);
+        residual_frame.at(SAI->i_order) = ii;
 
-            delete[](SAI->color);
-            SAI->color = nullptr;
+        SAI->has_color_residual = true;
 
-        }
+    }
+
+    /* ------------------------------
+    TEXTURE RESIDUAL DECODING ENDS
+    ------------------------------*/
+
+}
+
+/* applies the decoded residual to the prediction of view SAI */
+void encoder::reconstruct_texture_view(view *SAI) {
+
+    const int32_t bpc = 10;
+
+    int32_t Q = 1;
+    int32_t offset = 0;
+
+    if (SAI->level > 1) {
+        Q = 2;
+
+        offset = (1 << bpc) - 1; /* 10bit images currently */
+    }
+
+    aux_read16planar(
+        SAI->path_raw_prediction_at_encoder,
+        SAI->nc,
+        SAI->nr,
+        SAI->ncomp,
+        SAI->color);
+
+    if (SAI->has_color_residual) {
+
+        printf("Decoding texture residual for view %03d_%03d\n", SAI->c, SAI->r);
+
+        /* update SAI->color to contain
+        corrected (i.e., prediction + residual) version*/
+        apply_residual_view(
+            SAI->color,
+            get_residual_frame(
+                residual_seqs.at(SAI->level),
+                residual_frame.at(SAI->i_order)),
+            SAI->nr,
+            SAI->nc,
+            SAI->ncomp,
+            bpc,
+            Q,
+            offset);
 
     }
 
+    /*keep the decoded view, in internal colorspace, for the views referencing it*/
+    view_plan_store(
+        plan,
+        plan.texture_step.at(SAI->i_order),
+        SAI,
+        VIEWCACHE_TEXTURE,
+        SAI->color);
+
+    /*WRITE result to disk*/
+
+    /*writing .ppm in output colorspace,
+    If we only encode luminance, we have luminance as the first
+    component of the .ppm file !
+    */
+    write_output_ppm(
+        SAI->color,
+        SAI->path_out_ppm,
+        SAI->nr,
+        SAI->nc,
+        nc_color_ref,
+        bpc,
+        SAI->colorspace);
+
+    delete[](SAI->color);
+    SAI->color = nullptr;
+
 }
 
 void encoder::write_bitstream() {
@@ -1607,13 +2055,31 @@ void encoder::write_bitstream() {
         1,
         output_LF_file) * sizeof(int32_t);
 
-    uint8_t usedeflate = USE_DEFLATE;
+    /* bit 0 deflate, bit 1 median filtered normalized disparity followed
+    by the window size */
+    uint8_t header_flags = USE_DEFLATE ? 1 : 0;
+
+    if (depth_median_size > 0) {
+        header_flags |= 2;
+    }
+
     n_bytes_prediction += (uint32_t)fwrite(
-        &usedeflate,
+        &header_flags,
         sizeof(uint8_t),
         1,
         output_LF_file) * sizeof(uint8_t);
 
+    if (depth_median_size > 0) {
+
+        uint8_t median_size = static_cast<uint8_t>(depth_median_size);
+
+        n_bytes_prediction += (uint32_t)fwrite(
+            &median_size,
+            sizeof(uint8_t),
+            1,
+            output_LF_file) * sizeof(uint8_t);
+    }
+
     if (USE_DEFLATE)
     {
 
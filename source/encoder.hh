@@ -29,6 +29,10 @@
 
 #include "WaSPConf.hh"
 #include "view.hh"
+#include "viewplan.hh"
+#include "merging.hh"
+#include "residual.hh"
+#include "taskgraph.hh"
 
 using namespace std;
 
@@ -76,6 +80,9 @@ class encoder {
   bool USE_KVAZAAR = false;
   bool USE_DEFLATE = false;
 
+  /* window of the median filter on normalized disparity, 0 for none */
+  int32_t depth_median_size = 0;
+
   std::string colorspace_LF;
 
   uint8_t nc_sparse, nc_merge, nc_color_ref, n_seg_iterations;
@@ -92,8 +99,25 @@ class encoder {
 
   WaSPsetup setup;
 
+  view_plan plan; /* lifetimes of decoded views */
+
+  /* decoded HEVC residuals per level, frame residual_frame[i_order]
+  of residual_seqs[level] belongs to view i_order */
+  std::vector<decoded_residual_seq> residual_seqs;
+  std::vector<int32_t> residual_frame;
+
+  /* seeds of the model based QP search, per level from a previous run and
+  the final QP of the last coded level */
+  std::vector<int32_t> previous_run_QP;
+  int32_t previous_level_QP = -1;
+
  protected:
 
+  void begin_encoding();
+
+  bool same_normalized_disparity(const encoder &other) const;
+  void copy_normalized_disparity(const encoder &source);
+
   void load_config_json(string config_json_file);
   void write_config(string config_json_file_out); /*debug reasons*/
 
@@ -102,18 +126,38 @@ class encoder {
   void merge_texture_views(
       view *SAI,
       view *LF,
-      uint16_t **warped_texture_views,
-      float **DispTargs);
+      const warped_references &refs);
   
   void forward_warp_texture_references(
       view *LF,
       view *SAI,
-      uint16_t **warped_texture_views,
-      uint16_t **warped_depth_views,
-      float **DispTargs);
+      warped_references &refs);
+
+  void release_texture_references(
+      view *LF,
+      view *SAI);
+
+  void generate_views();
 
   void generate_normalized_disparity();
+  void code_normalized_disparity_level1();
+  void code_normalized_disparity_jp2(view *SAI);
+  std::vector<int32_t> add_normalized_disparity_tasks(
+      task_graph &graph,
+      const std::vector<std::vector<int32_t>> &dependencies);
+  void encode_normalized_disparity(view *SAI);
+
   void generate_texture();
+  void prepare_texture();
+  void add_texture_tasks(
+      task_graph &graph,
+      const std::vector<std::vector<int32_t>> &dependencies,
+      const std::vector<int32_t> &disparity_task);
+  void finish_texture();
+  std::vector<int32_t> views_at_level(const int32_t hlevel);
+  void predict_texture_view(view *SAI);
+  void encode_texture_residual(const int32_t hlevel);
+  void reconstruct_texture_view(view *SAI);
   void write_statsfile();
 
  public:
@@ -122,6 +166,10 @@ class encoder {
   encoder(WaSPsetup encoder_setup);
 
   void encode();
+
+  /* several configs (rate points) of the same light field, the stages
+  which do not depend on the rate are run once */
+  static void encode_batch(const WaSPsetup &batch_setup);
 };
 
 #endif
@@ -40,11 +40,6 @@ int32_t FastOLS_new(
     const int32_t MPHI, 
     const int32_t N) {
 
-  int32_t M, iM, iM1;
-  double *B, *C, sigerr, *Ag, *g;
-  double valm1, temp, crit, sabsval;
-  int32_t p, j_p, i, j, k, itemp;
-
   double *AA = *AAA;
   double *Yd = *Ydd;
 
@@ -108,6 +103,38 @@ int32_t FastOLS_new(
   delete[] (*Ydd);
   *Ydd = nullptr;
 
+  int32_t Mtrue = FastOLS_gram(
+      PHI,
+      PSI,
+      yd2,
+      PredRegr0,
+      PredTheta0,
+      Ms,
+      MT,
+      MPHI);
+
+  delete[] (PSI);
+  delete[] (PHI);
+
+  return Mtrue;
+
+}
+
+int32_t FastOLS_gram(
+    const double *PHI,
+    const double *PSI,
+    const double yd2,
+    int32_t *PredRegr0,
+    double *PredTheta0,
+    const int32_t Ms,
+    const int32_t MT,
+    const int32_t MPHI) {
+
+  int32_t M, iM, iM1;
+  double *B, *C, sigerr, *Ag, *g;
+  double valm1, temp, crit, sabsval;
+  int32_t p, j_p, i, j, k, itemp;
+
   // Usage example: Ms= 3 says the sparsity (length of final predictor) and MT =42 tells how many regressors are available
   // Finally, MPHI = 63 tells the dimensions of the matrices, for getting linear indices in PHI
   M = MT + 1;
@@ -139,6 +166,10 @@ int32_t FastOLS_new(
   crit = B[MT + MT * M];  //crit = B[MT,MT];
   if (crit < 0.0000001) {
     //printf("crir, yd2 [%f] [%f] ", crit, yd2);
+    delete[] (B);
+    delete[] (C);
+    delete[] (Ag);
+    delete[] (g);
     i = 0;
     return i;
   }
@@ -278,9 +309,6 @@ int32_t FastOLS_new(
   delete[] (Ag);
   delete[] (g);
 
-  delete[] (PSI);
-  delete[] (PHI);
-
   //printf("pred Ms [%d]",Ms);
   return i;
 
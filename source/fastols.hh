@@ -48,4 +48,16 @@ int32_t FastOLS_new(
     const int32_t MPHI, 
     const int32_t N);
 
+/* the same from the normal equations, PHI = A'A (MPHI x MPHI, column-major),
+PSI = A'y and yd2 = y'y */
+int32_t FastOLS_gram(
+    const double *PHI,
+    const double *PSI,
+    const double yd2,
+    int32_t *PredRegr0,
+    double *PredTheta0,
+    const int32_t Ms,
+    const int32_t MT,
+    const int32_t MPHI);
+
 #endif
@@ -27,8 +27,18 @@
 
 #include <sys/stat.h>
 #include <string>
+#include <system_error>
 #include <experimental/filesystem>
 
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "fileaux.hh"
 
 using namespace std;
@@ -48,8 +58,11 @@ bool aux_exists(string filename) {
 void aux_ensure_directory(string filename) {
     fs::path file_path(filename);
     fs::path parent_path = file_path.parent_path();
-    if (!aux_exists(parent_path.u8string()))
-        fs::create_directories(parent_path);
+    if (!aux_exists(parent_path.u8string())) {
+        /* may race with another thread creating the same directory */
+        std::error_code ec;
+        fs::create_directories(parent_path, ec);
+    }
 }
 
 void aux_ensure_directory(const char* filename) {
@@ -57,6 +70,27 @@ void aux_ensure_directory(const char* filename) {
     aux_ensure_directory(fname);
 }
 
+string aux_extension(const char* filename) {
+    fs::path file_path(filename);
+    return file_path.extension().u8string();
+}
+
+string aux_stem(const char* filename) {
+    fs::path file_path(filename);
+    return file_path.stem().u8string();
+}
+
+bool aux_copy_file(const char* from_filename, const char* to_filename) {
+    aux_ensure_directory(to_filename);
+    std::error_code ec;
+    fs::copy_file(
+        from_filename,
+        to_filename,
+        fs::copy_options::overwrite_existing,
+        ec);
+    return !ec;
+}
+
 int32_t system_1(char *str) {
   string sys_call_str(str);
 if (!SYSTEM_VERBOSE_QUIET)
@@ -89,3 +123,197 @@ long aux_GetFileSize(char* filename) {
   return aux_GetFileSize(sbuffer);
 }
 
+#ifdef _WIN32
+
+static bool aux_map_handle(
+    HANDLE file_handle,
+    const size_t size,
+    const bool writable,
+    aux_mapped_file &mfile) {
+
+    mfile.file_handle = file_handle;
+    mfile.size = size;
+
+    if (size == 0) {
+        return true;
+    }
+
+    HANDLE mapping_handle = CreateFileMappingA(
+        file_handle,
+        NULL,
+        writable ? PAGE_READWRITE : PAGE_READONLY,
+        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+        static_cast<DWORD>(size & 0xffffffff),
+        NULL);
+
+    if (mapping_handle == NULL) {
+        aux_unmap_file(mfile);
+        return false;
+    }
+
+    mfile.mapping_handle = mapping_handle;
+
+    mfile.data = static_cast<uint8_t*>(MapViewOfFile(
+        mapping_handle,
+        writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+        0,
+        0,
+        size));
+
+    if (mfile.data == nullptr) {
+        aux_unmap_file(mfile);
+        return false;
+    }
+
+    return true;
+}
+
+bool aux_map_file(const char* filename, aux_mapped_file &mfile) {
+
+    HANDLE file_handle = CreateFileA(
+        filename,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL);
+
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+
+    if (!GetFileSizeEx(file_handle, &file_size)) {
+        CloseHandle(file_handle);
+        return false;
+    }
+
+    return aux_map_handle(
+        file_handle,
+        static_cast<size_t>(file_size.QuadPart),
+        false,
+        mfile);
+}
+
+bool aux_map_file_write(
+    const char* filename,
+    const size_t size,
+    aux_mapped_file &mfile) {
+
+    HANDLE file_handle = CreateFileA(
+        filename,
+        GENERIC_READ | GENERIC_WRITE,
+        0,
+        NULL,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    return aux_map_handle(file_handle, size, true, mfile);
+}
+
+void aux_unmap_file(aux_mapped_file &mfile) {
+
+    if (mfile.data != nullptr) {
+        UnmapViewOfFile(mfile.data);
+    }
+    if (mfile.mapping_handle != nullptr) {
+        CloseHandle(static_cast<HANDLE>(mfile.mapping_handle));
+    }
+    if (mfile.file_handle != nullptr) {
+        CloseHandle(static_cast<HANDLE>(mfile.file_handle));
+    }
+
+    mfile = aux_mapped_file();
+}
+
+#else
+
+bool aux_map_file(const char* filename, aux_mapped_file &mfile) {
+
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat stat_buf;
+
+    if (fstat(fd, &stat_buf) != 0) {
+        close(fd);
+        return false;
+    }
+
+    mfile.fd = fd;
+    mfile.size = static_cast<size_t>(stat_buf.st_size);
+
+    if (mfile.size == 0) {
+        return true;
+    }
+
+    void *addr = mmap(NULL, mfile.size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (addr == MAP_FAILED) {
+        aux_unmap_file(mfile);
+        return false;
+    }
+
+    mfile.data = static_cast<uint8_t*>(addr);
+
+    return true;
+}
+
+bool aux_map_file_write(
+    const char* filename,
+    const size_t size,
+    aux_mapped_file &mfile) {
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    mfile.fd = fd;
+    mfile.size = size;
+
+    if (size == 0) {
+        return true;
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        aux_unmap_file(mfile);
+        return false;
+    }
+
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (addr == MAP_FAILED) {
+        aux_unmap_file(mfile);
+        return false;
+    }
+
+    mfile.data = static_cast<uint8_t*>(addr);
+
+    return true;
+}
+
+void aux_unmap_file(aux_mapped_file &mfile) {
+
+    if (mfile.data != nullptr) {
+        munmap(mfile.data, mfile.size);
+    }
+    if (mfile.fd >= 0) {
+        close(mfile.fd);
+    }
+
+    mfile = aux_mapped_file();
+}
+
+#endif
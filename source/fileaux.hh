@@ -32,6 +32,8 @@
 #define _pclose pclose
 #endif
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 using namespace std;
@@ -43,10 +45,45 @@ bool aux_exists(string filename);
 void aux_ensure_directory(string filename);
 void aux_ensure_directory(const char* filename);
 
+/*extension of filename including the dot, empty if there is none*/
+string aux_extension(const char* filename);
+
+/*filename without directory and extension*/
+string aux_stem(const char* filename);
+
+/*copies (overwrites) to_filename, creating its directory*/
+bool aux_copy_file(const char* from_filename, const char* to_filename);
+
 int32_t system_1(char *str);
 
 long aux_GetFileSize(const char* filename);
 long aux_GetFileSize(char* filename);
 long aux_GetFileSize(string filename);
 
+/*memory mapping of a whole file*/
+struct aux_mapped_file {
+
+    uint8_t *data = nullptr;
+    size_t size = 0;
+
+#ifdef _WIN32
+    void *file_handle = nullptr;
+    void *mapping_handle = nullptr;
+#else
+    int fd = -1;
+#endif
+
+};
+
+/*read-only mapping of an existing file*/
+bool aux_map_file(const char* filename, aux_mapped_file &mfile);
+
+/*creates (or truncates) filename to size bytes and maps it for writing*/
+bool aux_map_file_write(
+    const char* filename,
+    const size_t size,
+    aux_mapped_file &mfile);
+
+void aux_unmap_file(aux_mapped_file &mfile);
+
 #endif
@@ -29,77 +29,83 @@
 
 #include <cstdint>
 #include <cstring>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
 
 #include "medianfilter.hh"
 
+/* fills hole ii with the median of its 8-neighbours which are not holes,
+returns false if there are none */
 template<class T1, class T2>
-uint32_t inpainting(
+bool inpaint_pixel(
     T1 *pshort,
     const int32_t nr,
     const int32_t nc,
     const T2 maskval,
-    T2 *mask_img) {
+    const T2 *mask_img,
+    const int32_t ii) {
 
-    std::vector<T1> neighbours;
-    int32_t dsz = 1;
-
-    //T2 *mask_im_work_copy = new T2[nr*nc]();
-    //memcpy(mask_im_work_copy, mask_img, sizeof(T2)*nr*nc);
+    T1 neighbours[8];
+    int32_t n_neighbours = 0;
 
-    uint32_t nholes_remaining = 0;
-
-    for (int32_t ii = 0; ii < nr * nc; ii++) {
-        int32_t y, x;
-        y = ii % nr;
-        x = (ii / nr);
-
-        bool is_hole = 
-            (static_cast<int32_t>(mask_img[ii]) == static_cast<int32_t>(maskval));
+    int32_t dsz = 1;
 
-        if (is_hole) {
-            neighbours.clear();
-            for (int32_t dy = -dsz; dy <= dsz; dy++) {
-                for (int32_t dx = -dsz; dx <= dsz; dx++) {
-                    if (!(dy == 0 && dx == 0)) {
+    int32_t y, x;
+    y = ii % nr;
+    x = (ii / nr);
 
-                        if (
-                            (y + dy) >= 0 &&
-                            (y + dy) < nr &&
-                            (x + dx) >= 0 &&
-                            (x + dx) < nc)
-                        {
+    for (int32_t dy = -dsz; dy <= dsz; dy++) {
+        for (int32_t dx = -dsz; dx <= dsz; dx++) {
+            if (!(dy == 0 && dx == 0)) {
 
-                            int32_t lin_ind = y + dy + (x + dx) * nr;
+                if (
+                    (y + dy) >= 0 &&
+                    (y + dy) < nr &&
+                    (x + dx) >= 0 &&
+                    (x + dx) < nc)
+                {
 
-                            bool is_hole_again =
-                                (static_cast<int32_t>(mask_img[lin_ind]) == static_cast<int32_t>(maskval));
+                    int32_t lin_ind = y + dy + (x + dx) * nr;
 
-                            if (!is_hole_again) 
-                            {
-                                neighbours.push_back(pshort[lin_ind]);
-                            }
+                    bool is_hole_again =
+                        (static_cast<int32_t>(mask_img[lin_ind]) == static_cast<int32_t>(maskval));
 
-                        }
+                    if (!is_hole_again) 
+                    {
+                        neighbours[n_neighbours++] = pshort[lin_ind];
                     }
+
                 }
             }
-            if (neighbours.size() > 0) {
-                pshort[ii] = getMedian(neighbours); // neighbours.at(2);//
-                mask_img[ii] = mask_img[ii] + static_cast<T2>(1);
-            }
-            else {
-                nholes_remaining++;
-            }
         }
     }
 
-    //delete[](mask_im_work_copy);
+    if (n_neighbours == 0) {
+        return false;
+    }
+
+    /* the element getMedian picks */
+    std::nth_element(
+        neighbours,
+        neighbours + n_neighbours / 2,
+        neighbours + n_neighbours);
 
-    //printf("holes remaining:\t%d\n", nholes_remaining);
+    pshort[ii] = neighbours[n_neighbours / 2];
 
-    return nholes_remaining;
+    return true;
 }
 
+/* Fills the holes (mask_img == maskval) of pshort from the outside in. A
+sweep visits holes in scan order and fills those with known neighbours,
+holes filled earlier in the same sweep count as known. The first sweep
+visits every hole, after that only the frontier is visited: when a hole is
+filled, its hole neighbours are queued, for the current sweep if they come
+later in scan order and for the next one otherwise. The other holes have
+no new known neighbours and could not be filled anyway. Returns the number
+of holes which could not be filled, i.e., those of an image without any
+known pixel. */
 template<class T1, class T2>
 uint32_t holefilling(
     T1 *pshort,
@@ -111,16 +117,96 @@ uint32_t holefilling(
     T2 *mask_img_work = new T2[nr*nc]();
     memcpy(mask_img_work, mask_img, sizeof(T2)*nr*nc);
 
-    while (inpainting(
-        pshort,
-        nr,
-        nc,
-        maskval,
-        mask_img_work) > 0);
+    /* sweep in which a hole was last queued */
+    std::vector<int32_t> queued(nr*nc, 0);
+
+    std::vector<int32_t> sweep_holes;
+    std::vector<int32_t> next_holes;
+
+    /* holes queued during the sweep, later in scan order */
+    std::priority_queue<
+        int32_t,
+        std::vector<int32_t>,
+        std::greater<int32_t>> ahead;
+
+    int32_t sweep = 1;
+
+    for (int32_t ii = 0; ii < nr * nc; ii++) {
+        if (static_cast<int32_t>(mask_img_work[ii]) == static_cast<int32_t>(maskval)) {
+            sweep_holes.push_back(ii);
+            queued[ii] = sweep;
+        }
+    }
+
+    uint32_t n_holes = static_cast<uint32_t>(sweep_holes.size());
+
+    while (sweep_holes.size() > 0) {
+
+        next_holes.clear();
+
+        size_t is = 0;
+
+        while (is < sweep_holes.size() || !ahead.empty()) {
+
+            int32_t ii;
+
+            if (ahead.empty() ||
+                (is < sweep_holes.size() && sweep_holes[is] < ahead.top()))
+            {
+                ii = sweep_holes[is++];
+            }
+            else {
+                ii = ahead.top();
+                ahead.pop();
+            }
+
+            if (!inpaint_pixel(pshort, nr, nc, maskval, mask_img_work, ii)) {
+                continue;
+            }
+
+            mask_img_work[ii] = mask_img_work[ii] + static_cast<T2>(1);
+            n_holes--;
+
+            const int32_t y = ii % nr;
+            const int32_t x = ii / nr;
+
+            for (int32_t dx = -1; dx <= 1; dx++) {
+                for (int32_t dy = -1; dy <= 1; dy++) {
+
+                    if ((y + dy) < 0 || (y + dy) >= nr || (x + dx) < 0 || (x + dx) >= nc) {
+                        continue;
+                    }
+
+                    const int32_t ij = y + dy + (x + dx) * nr;
+
+                    if (static_cast<int32_t>(mask_img_work[ij]) != static_cast<int32_t>(maskval)) {
+                        continue;
+                    }
+
+                    if (ij > ii) {
+                        if (queued[ij] < sweep) {
+                            queued[ij] = sweep;
+                            ahead.push(ij);
+                        }
+                    }
+                    else if (queued[ij] < sweep + 1) {
+                        queued[ij] = sweep + 1;
+                        next_holes.push_back(ij);
+                    }
+                }
+            }
+        }
+
+        std::sort(next_holes.begin(), next_holes.end());
+
+        sweep_holes.swap(next_holes);
+
+        sweep++;
+    }
 
     delete[](mask_img_work);
 
-    return 0;
+    return n_holes;
 }
 
 #endif
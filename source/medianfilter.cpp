@@ -0,0 +1,276 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "medianfilter.hh"
+#include "mediannetwork.hh"
+
+#include <vector>
+#include <algorithm>
+#include <climits>
+
+/* memory for the column histograms of a strip of rows */
+#define MEDFILT_STRIP_BYTES (16 * 1024 * 1024)
+
+/* 3x3, eight pixels of a column at a time through the median networks */
+static void medfilt2D_3x3(
+    const uint16_t *input,
+    uint16_t *output,
+    const int32_t nr,
+    const int32_t nc) {
+
+    uint16_t candidates[9 * MEDIAN_NETWORK_LANES];
+    int32_t count[MEDIAN_NETWORK_LANES];
+    uint16_t median[MEDIAN_NETWORK_LANES];
+
+    for (int32_t x = 0; x < nc; x++) {
+
+        for (int32_t y0 = 0; y0 < nr; y0 += MEDIAN_NETWORK_LANES) {
+
+            const int32_t n_lanes = std::min(MEDIAN_NETWORK_LANES, nr - y0);
+
+            for (int32_t p = 0; p < MEDIAN_NETWORK_LANES; p++) {
+
+                count[p] = 0;
+
+                if (p >= n_lanes) {
+                    continue;
+                }
+
+                const int32_t y = y0 + p;
+
+                for (int32_t dy = -1; dy <= 1; dy++) {
+                    for (int32_t dx = -1; dx <= 1; dx++) {
+                        if ((y + dy) >= 0 && (y + dy) < nr && (x + dx) >= 0 && (x + dx) < nc) {
+                            candidates[count[p]++ * MEDIAN_NETWORK_LANES + p] =
+                                input[y + dy + (x + dx) * nr];
+                        }
+                    }
+                }
+            }
+
+            median_network(candidates, count, 9, median);
+
+            for (int32_t p = 0; p < n_lanes; p++) {
+                output[y0 + p + x * nr] = median[p];
+            }
+        }
+    }
+}
+
+/* Sliding histogram median (Perreault and Hebert, 2007) with the roles of
+rows and columns swapped for the column-major images. For every row j of a
+strip, a histogram over the window columns x-r..x+r is kept and moved by one
+column per step of x (one add and one remove). The window histogram of row
+y is the sum of the row histograms y-r..y+r and is moved along y in the same
+way. Histograms are two-level, coarse bins of the high bits are kept up to
+date and the fine bins of a coarse bin are brought up to date only when the
+median falls in it. Values are taken relative to the image minimum, so
+10-bit data gets small histograms. */
+static void medfilt2D_histogram(
+    const uint16_t *input,
+    uint16_t *output,
+    const int32_t SZ,
+    const int32_t nr,
+    const int32_t nc) {
+
+    const int32_t r = SZ / 2;
+    const int32_t nrnc = nr * nc;
+
+    uint16_t vmin = 65535, vmax = 0;
+
+    for (int32_t ii = 0; ii < nrnc; ii++) {
+        vmin = std::min(vmin, input[ii]);
+        vmax = std::max(vmax, input[ii]);
+    }
+
+    int32_t bits = 0;
+
+    while ((1 << bits) <= vmax - vmin) {
+        bits++;
+    }
+
+    const int32_t fine_bits = bits / 2;
+    const int32_t n_fine = 1 << fine_bits;
+    const int32_t n_coarse = 1 << (bits - fine_bits);
+    const int32_t n_bins = n_coarse * n_fine;
+
+    /* rows of output per strip, the strip needs r more rows below and r+1
+    above, the one leaving the window at the first row */
+    const int32_t bytes_per_row =
+        static_cast<int32_t>(sizeof(uint16_t)) * (n_bins + n_coarse);
+
+    const int32_t strip_rows = std::max(
+        1,
+        MEDFILT_STRIP_BYTES / bytes_per_row - 2 * r - 1);
+
+    std::vector<uint16_t> row_coarse;
+    std::vector<uint16_t> row_fine;
+
+    std::vector<int32_t> window_coarse(n_coarse);
+    std::vector<int32_t> window_fine(n_bins);
+
+    /* row up to which the fine bins of a coarse bin are up to date */
+    std::vector<int32_t> fine_row(n_coarse);
+
+    for (int32_t s0 = 0; s0 < nr; s0 += strip_rows) {
+
+        const int32_t s1 = std::min(nr, s0 + strip_rows);
+
+        const int32_t j0 = std::max(0, s0 - r - 1);
+        const int32_t j1 = std::min(nr, s1 + r);
+
+        row_coarse.assign(static_cast<size_t>(j1 - j0) * n_coarse, 0);
+        row_fine.assign(static_cast<size_t>(j1 - j0) * n_bins, 0);
+
+        auto row_update = [&](const int32_t x, const int32_t delta) {
+
+            for (int32_t j = j0; j < j1; j++) {
+
+                const int32_t v = input[j + x * nr] - vmin;
+
+                row_coarse[(j - j0) * n_coarse + (v >> fine_bits)] += delta;
+                row_fine[static_cast<size_t>(j - j0) * n_bins + v] += delta;
+            }
+        };
+
+        for (int32_t x = 0; x < std::min(r, nc); x++) {
+            row_update(x, 1);
+        }
+
+        for (int32_t x = 0; x < nc; x++) {
+
+            /* row histograms over columns x-r..x+r */
+            if (x + r < nc) {
+                row_update(x + r, 1);
+            }
+            if (x - r - 1 >= 0) {
+                row_update(x - r - 1, -1);
+            }
+
+            const int32_t n_cols = std::min(nc - 1, x + r) - std::max(0, x - r) + 1;
+
+            std::fill(window_coarse.begin(), window_coarse.end(), 0);
+            std::fill(fine_row.begin(), fine_row.end(), INT_MIN / 2);
+
+            for (int32_t j = j0; j < std::min(nr, s0 + r); j++) {
+                for (int32_t c = 0; c < n_coarse; c++) {
+                    window_coarse[c] += row_coarse[(j - j0) * n_coarse + c];
+                }
+            }
+
+            for (int32_t y = s0; y < s1; y++) {
+
+                /* window histogram over rows y-r..y+r */
+                if (y + r < nr) {
+                    for (int32_t c = 0; c < n_coarse; c++) {
+                        window_coarse[c] += row_coarse[(y + r - j0) * n_coarse + c];
+                    }
+                }
+                if (y - r - 1 >= 0) {
+                    for (int32_t c = 0; c < n_coarse; c++) {
+                        window_coarse[c] -= row_coarse[(y - r - 1 - j0) * n_coarse + c];
+                    }
+                }
+
+                const int32_t n_rows = std::min(nr - 1, y + r) - std::max(0, y - r) + 1;
+
+                /* element n/2 of the sorted window, as getMedian */
+                int32_t rank = (n_rows * n_cols) / 2;
+
+                int32_t c = 0;
+
+                while (rank >= window_coarse[c]) {
+                    rank -= window_coarse[c];
+                    c++;
+                }
+
+                int32_t *fine = window_fine.data() + c * n_fine;
+
+                if (y - fine_row[c] >= SZ) {
+
+                    std::fill(fine, fine + n_fine, 0);
+
+                    for (int32_t j = std::max(0, y - r); j <= std::min(nr - 1, y + r); j++) {
+                        const uint16_t *row = row_fine.data() + static_cast<size_t>(j - j0) * n_bins + c * n_fine;
+                        for (int32_t f = 0; f < n_fine; f++) {
+                            fine[f] += row[f];
+                        }
+                    }
+                }
+                else {
+
+                    for (int32_t yy = fine_row[c] + 1; yy <= y; yy++) {
+
+                        if (yy + r < nr) {
+                            const uint16_t *row = row_fine.data() + static_cast<size_t>(yy + r - j0) * n_bins + c * n_fine;
+                            for (int32_t f = 0; f < n_fine; f++) {
+                                fine[f] += row[f];
+                            }
+                        }
+                        if (yy - r - 1 >= 0) {
+                            const uint16_t *row = row_fine.data() + static_cast<size_t>(yy - r - 1 - j0) * n_bins + c * n_fine;
+                            for (int32_t f = 0; f < n_fine; f++) {
+                                fine[f] -= row[f];
+                            }
+                        }
+                    }
+                }
+
+                fine_row[c] = y;
+
+                int32_t f = 0;
+
+                while (rank >= fine[f]) {
+                    rank -= fine[f];
+                    f++;
+                }
+
+                output[y + x * nr] = static_cast<uint16_t>(vmin + c * n_fine + f);
+            }
+        }
+    }
+}
+
+uint16_t *medfilt2D_uint16(
+    const uint16_t *input,
+    const int32_t SZ,
+    const int32_t nr,
+    const int32_t nc) {
+
+    uint16_t *output = new uint16_t[nr*nc]();
+
+    if (SZ <= 1) {
+        std::copy(input, input + nr*nc, output);
+    }
+    else if (SZ == 3) {
+        medfilt2D_3x3(input, output, nr, nc);
+    }
+    else {
+        medfilt2D_histogram(input, output, SZ, nr, nc);
+    }
+
+    return output;
+}
@@ -27,6 +27,8 @@
 #ifndef MEDIANFILTER_HH
 #define MEDIANFILTER_HH
 
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include <algorithm>
 #include <cmath>
@@ -90,7 +92,7 @@ T *medfilt2D(
             for (int32_t dy = -dsz; dy <= dsz; dy++) {
                 for (int32_t dx = -dsz; dx <= dsz; dx++) {
                     if ((y + dy) >= 0 && (y + dy) < nr && (x + dx) >= 0 && (x + dx) < nc)
-                        scores.push_back(output[y + dy + (x + dx) * nr]);
+                        scores.push_back(input[y + dy + (x + dx) * nr]);
                 }
             }
             output[y + x * nr] = getMedian(scores);
@@ -100,4 +102,14 @@ T *medfilt2D(
     return output;
 }
 
+/* median filter of uint16 data over SZ x SZ windows (odd SZ) clipped at
+the image borders, returns a new[] image. The result is the one of
+medfilt2D, 3x3 runs on the median networks (mediannetwork.hh) and larger
+windows on sliding histograms whose cost per pixel does not grow with SZ. */
+uint16_t *medfilt2D_uint16(
+    const uint16_t *input,
+    const int32_t SZ,
+    const int32_t nr,
+    const int32_t nc);
+
 #endif
@@ -0,0 +1,185 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "mediannetwork.hh"
+#include "medianfilter.hh"
+
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE4_1__) || defined(__AVX__)
+#define MEDIAN_SSE41
+#include <smmintrin.h>
+#endif
+
+/* the lanes of the network, one pixel per lane */
+
+#ifdef MEDIAN_SSE41
+
+typedef __m128i median_lanes;
+
+static inline median_lanes lanes_load(const uint16_t *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static inline void lanes_store(uint16_t *p, const median_lanes a) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a);
+}
+
+static inline void lanes_compare_exchange(median_lanes &a, median_lanes &b) {
+    const median_lanes lo = _mm_min_epu16(a, b);
+    b = _mm_max_epu16(a, b);
+    a = lo;
+}
+
+#else
+
+struct median_lanes {
+    uint16_t v[MEDIAN_NETWORK_LANES];
+};
+
+static inline median_lanes lanes_load(const uint16_t *p) {
+    median_lanes a;
+    std::copy(p, p + MEDIAN_NETWORK_LANES, a.v);
+    return a;
+}
+
+static inline void lanes_store(uint16_t *p, const median_lanes a) {
+    std::copy(a.v, a.v + MEDIAN_NETWORK_LANES, p);
+}
+
+static inline void lanes_compare_exchange(median_lanes &a, median_lanes &b) {
+    for (int32_t p = 0; p < MEDIAN_NETWORK_LANES; p++) {
+        const uint16_t lo = std::min(a.v[p], b.v[p]);
+        b.v[p] = std::max(a.v[p], b.v[p]);
+        a.v[p] = lo;
+    }
+}
+
+#endif
+
+/* Batcher's odd-even merge sort of N = 2^k slots, the loops have constant
+bounds and unroll into the network */
+template<int32_t N>
+static inline void sort_network(median_lanes *r) {
+
+    for (int32_t p = 1; p < N; p += p) {
+        for (int32_t k = p; k > 0; k /= 2) {
+            for (int32_t j = k % p; j + k < N; j += k + k) {
+                for (int32_t i = 0; i < k && i + j + k < N; i++) {
+                    if ((i + j) / (p + p) == (i + j + k) / (p + p)) {
+                        lanes_compare_exchange(r[i + j], r[i + j + k]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* A pixel with n candidates gets N/2 - n/2 slots of 0 below them and the
+rest of the slots 0xFFFF above them. Its median is then slot N/2 of the
+sorted slots for every n <= N, so all lanes pick the same slot. */
+template<int32_t N>
+static void median_slots(
+    const uint16_t *candidates,
+    const int32_t *count,
+    uint16_t *median) {
+
+    uint16_t slots[N*MEDIAN_NETWORK_LANES];
+
+    for (int32_t p = 0; p < MEDIAN_NETWORK_LANES; p++) {
+
+        const int32_t n_low = N / 2 - count[p] / 2;
+
+        for (int32_t is = 0; is < N; is++) {
+
+            uint16_t value = 0xFFFF;
+
+            if (is < n_low) {
+                value = 0;
+            }
+            else if (is < n_low + count[p]) {
+                value = candidates[(is - n_low)*MEDIAN_NETWORK_LANES + p];
+            }
+
+            slots[is*MEDIAN_NETWORK_LANES + p] = value;
+        }
+    }
+
+    median_lanes r[N];
+
+    for (int32_t is = 0; is < N; is++) {
+        r[is] = lanes_load(slots + is*MEDIAN_NETWORK_LANES);
+    }
+
+    sort_network<N>(r);
+
+    uint16_t sorted[MEDIAN_NETWORK_LANES];
+
+    lanes_store(sorted, r[N / 2]);
+
+    for (int32_t p = 0; p < MEDIAN_NETWORK_LANES; p++) {
+        median[p] = count[p] > 0 ? sorted[p] : 0;
+    }
+}
+
+void median_network(
+    const uint16_t *candidates,
+    const int32_t *count,
+    const int32_t n_max,
+    uint16_t *median) {
+
+    if (n_max <= 1) {
+        median_slots<1>(candidates, count, median);
+    }
+    else if (n_max <= 2) {
+        median_slots<2>(candidates, count, median);
+    }
+    else if (n_max <= 4) {
+        median_slots<4>(candidates, count, median);
+    }
+    else if (n_max <= 8) {
+        median_slots<8>(candidates, count, median);
+    }
+    else if (n_max <= MEDIAN_NETWORK_MAX) {
+        median_slots<MEDIAN_NETWORK_MAX>(candidates, count, median);
+    }
+    else {
+
+        std::vector<uint16_t> vals;
+
+        for (int32_t p = 0; p < MEDIAN_NETWORK_LANES; p++) {
+
+            vals.clear();
+
+            for (int32_t is = 0; is < count[p]; is++) {
+                vals.push_back(candidates[is*MEDIAN_NETWORK_LANES + p]);
+            }
+
+            median[p] = vals.size() > 0 ? getMedian(vals) : 0;
+        }
+    }
+}
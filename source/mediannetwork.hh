@@ -0,0 +1,56 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MEDIANNETWORK_HH
+#define MEDIANNETWORK_HH
+
+#include <cstdint>
+
+using std::int32_t;
+using std::uint32_t;
+
+using std::int16_t;
+using std::uint16_t;
+
+/* Medians of small candidate sets without allocations. The candidates are
+padded to 1, 2, 4, 8 or 16 slots and sorted with a fixed odd-even merge
+network, eight pixels at a time (one per SIMD lane). */
+
+#define MEDIAN_NETWORK_LANES 8
+#define MEDIAN_NETWORK_MAX 16
+
+/* Medians of MEDIAN_NETWORK_LANES pixels. Candidate is of pixel p is
+candidates[is*MEDIAN_NETWORK_LANES + p] for is < count[p], and
+n_max >= count[p]. The median is the one of getMedian, i.e., the element
+count/2 of the sorted candidates, and 0 for a pixel without candidates.
+More than MEDIAN_NETWORK_MAX candidates fall back to getMedian. */
+void median_network(
+    const uint16_t *candidates,
+    const int32_t *count,
+    const int32_t n_max,
+    uint16_t *median);
+
+#endif
@@ -25,50 +25,34 @@
 */
 #include "merging.hh"
 #include "medianfilter.hh"
+#include "mediannetwork.hh"
 #include "fastols.hh"
 #include "bitdepth.hh"
 #include "warping.hh"
 
 #include <cstring>
 #include <cmath>
+#include <vector>
+#include <algorithm>
 
-void init_warping_arrays(
+/* the vector merge sums in 32 bits, which is exact for up to 16 references
+of at most 11-bit samples */
+#if defined(__AVX2__) && BIT_DEPTH <= 11
+#define MERGE_AVX2
+#include <immintrin.h>
+#endif
+
+void init_warped_references(
     const int32_t N,
-    uint16_t **&warped_texture_views,
-    uint16_t **&warped_depth_views,
-    float **&DispTargs,
     const int32_t nr,
     const int32_t nc,
-    const int32_t ncomp) {
-
-    /* holds partial warped views for ii */
-    warped_texture_views = new uint16_t*[N]();
-    warped_depth_views = new uint16_t*[N]();
-    DispTargs = new float*[N]();
-
-    for (int32_t ij = 0; ij < N; ij++) {
-        warped_texture_views[ij] = new uint16_t[nr*nc*ncomp]();
-        warped_depth_views[ij] = new uint16_t[nr*nc]();
-        DispTargs[ij] = new float[nr*nc]();
-    }
-}
-
-void clean_warping_arrays(
-    const int32_t N,
-    uint16_t **warped_texture_views,
-    uint16_t **warped_depth_views,
-    float **DispTargs) {
-
-    /* clean */
-    for (int32_t ij = 0; ij < N; ij++) {
-        delete[](warped_texture_views[ij]);
-        delete[](warped_depth_views[ij]);
-        delete[](DispTargs[ij]);
-    }
+    const int32_t ncomp,
+    warped_references &refs) {
 
-    delete[](warped_texture_views);
-    delete[](warped_depth_views);
-    delete[](DispTargs);
+    refs.nrnc = nr*nc;
+    refs.ncomp = ncomp;
+    refs.textures.assign(N, nullptr);
+    refs.source.assign(static_cast<size_t>(N)*nr*nc, WARP_NO_SOURCE);
 }
 
 void setBMask(view *view0) {
@@ -89,7 +73,7 @@ void setBMask(view *view0) {
   view0->bmask = bmask;
 }
 
-void initSegVp(view *view0, float **DispTargs) {
+void initSegVp(view *view0, const warped_references &refs) {
 
   int32_t nr = view0->nr;
   int32_t nc = view0->nc;
@@ -106,8 +90,7 @@ void initSegVp(view *view0, float **DispTargs) {
     uint16_t ci = 0;
 
     for (int32_t ik = 0; ik < n_references; ik++) {
-      float *pf = DispTargs[ik];
-      if (*(pf + ii) > INIT_DISPARITY_VALUE)
+      if (refs.available(ik, ii))
         ci = ci + (uint16_t) (1 << ik);
     }
 
@@ -121,7 +104,7 @@ void initSegVp(view *view0, float **DispTargs) {
   view0->seg_vp = seg_vp;
 }
 
-void initViewW(view *view0, float **DispTargs) {
+void initViewW(view *view0, const warped_references &refs) {
 
     /* sets some of the parameters for a view in the light view structure */
 
@@ -138,42 +121,51 @@ void initViewW(view *view0, float **DispTargs) {
 
     setBMask(view0);
 
-    initSegVp(view0, DispTargs);
+    initSegVp(view0, refs);
 
 }
 
-void mergeMedian_N(uint16_t **warpedColorViews, float **DispTargs,
-                   view *view0, const int32_t ncomponents) {
+void mergeMedian_N(
+    const warped_references &refs,
+    view *view0,
+    const int32_t ncomponents) {
+
+  const int32_t nrnc = view0->nr * view0->nc;
+  const int32_t n_references = view0->n_references;
 
-  uint16_t *AA2 =
-      new uint16_t[view0->nr * view0->nc * ncomponents]();
+  /* candidates of MEDIAN_NETWORK_LANES pixels at a time */
+  std::vector<uint16_t> candidates(n_references*MEDIAN_NETWORK_LANES);
+  int32_t count[MEDIAN_NETWORK_LANES];
+  uint16_t median[MEDIAN_NETWORK_LANES];
 
-//#pragma omp parallel for
-  for (int32_t ii = 0; ii < view0->nr * view0->nc; ii++) {
-    for (int32_t icomp = 0; icomp < ncomponents; icomp++) {
-      std::vector<uint16_t> vals;
-      for (int32_t ik = 0; ik < view0->n_references; ik++) {
+  for (int32_t ii0 = 0; ii0 < nrnc; ii0 += MEDIAN_NETWORK_LANES) {
 
-        float *pf = DispTargs[ik];
-        uint16_t *ps = warpedColorViews[ik];
+    const int32_t n_lanes = std::min(MEDIAN_NETWORK_LANES, nrnc - ii0);
 
-        if (*(pf + ii) > INIT_DISPARITY_VALUE) {
+    for (int32_t icomp = 0; icomp < 3; icomp++) {
 
-          vals.push_back(*(ps + ii + icomp * view0->nr * view0->nc));
+      for (int32_t p = 0; p < MEDIAN_NETWORK_LANES; p++) {
 
-        }
+        count[p] = 0;
 
+        if (p < n_lanes && icomp < ncomponents) {
+          for (int32_t ik = 0; ik < n_references; ik++) {
+            if (refs.available(ik, ii0 + p)) {
+              candidates[count[p]++ * MEDIAN_NETWORK_LANES + p] =
+                  refs.color(ik, ii0 + p, icomp);
+            }
+          }
+        }
       }
 
-      if (vals.size() > 0) {
-        *(AA2 + ii + icomp * view0->nr * view0->nc) = getMedian(vals);
+      median_network(candidates.data(), count, n_references, median);
+
+      for (int32_t p = 0; p < n_lanes; p++) {
+        view0->color[ii0 + p + icomp * nrnc] = median[p];
       }
     }
   }
 
-  memcpy(view0->color, AA2, sizeof(uint16_t) * view0->nr * view0->nc * 3);
-  delete[] (AA2);
-
 }
 
 void printMatrix(
@@ -193,78 +185,194 @@ void printMatrix(
 
 }
 
-void mergeWarped_N_icomp(
-    uint16_t **warpedColorViews,
-    view *view0,
-    const int32_t icomp) {
+/* The blend is sum_ik w_ik*c_ik / 2^BIT_DEPTH_MERGE with integer weights
+and colours, every term and partial sum of the original double arithmetic
+is exact. Clamping and rounding the integer sum S therefore gives the same
+result: 0 for S < 0, otherwise min(max, (S + 2^(B-1)) >> B). */
 
-    int32_t MMM = 1 << view0->n_references;  // pow(2, (view0)->n_references);
+static inline uint16_t merge_round(const int64_t S) {
 
-    int32_t N_LS = MMM*view0->n_references;
+    const int64_t maxval = (1 << BIT_DEPTH) - 1;
 
-    bool *bmask = view0->bmask;
+    if (S < 0) {
+        return 0;
+    }
 
-    int32_t uu = icomp*((MMM*view0->n_references) / 2);
+    const int64_t v = (S + (1 << (BIT_DEPTH_MERGE - 1))) >> BIT_DEPTH_MERGE;
 
-    for (int32_t ii = 0; ii < N_LS; ii++) {
-        if (bmask[ii]) {
-            view0->merge_weights_double[ii] =
-                ((double)(view0)->merge_weights[uu++])
-                / (double)(1 << BIT_DEPTH_MERGE);
-        }
-        else {
-            (view0)->merge_weights_double[ii] = 0.0;
+    return static_cast<uint16_t>(v > maxval ? maxval : v);
+}
+
+static void mergeWarped_N_scalar(
+    const warped_references &refs,
+    const view *view0,
+    const int32_t *w,
+    const int32_t ncomponents,
+    const int32_t first,
+    const int32_t last) {
+
+    const int32_t MMM = 1 << view0->n_references;
+    const int32_t N_LS = MMM*view0->n_references;
+    const int32_t nrnc = view0->nr*view0->nc;
+
+    const uint16_t *seg_vp = view0->seg_vp;
+
+    for (int32_t ii = first; ii < last; ii++) {
+
+        const int32_t ci = seg_vp[ii];
+
+        for (int32_t icomp = 0; icomp < ncomponents; icomp++) {
+
+            const int32_t *w_icomp = w + icomp*N_LS;
+
+            int64_t S = 0;
+
+            for (int32_t ik = 0; ik < view0->n_references; ik++) {
+                S += static_cast<int64_t>(w_icomp[ci + ik * MMM]) *
+                    refs.color(ik, ii, icomp);
+            }
+
+            view0->color[ii + icomp*nrnc] = merge_round(S);
         }
     }
+}
 
-    /*printMatrix(
-        view0->merge_weights_double,
-        MMM,
-        view0->n_references);*/
+#ifdef MERGE_AVX2
+/* eight pixels at a time, the weights are gathered by occlusion class and
+the colours by source pixel. Returns the number of pixels done. */
+static int32_t mergeWarped_N_avx2(
+    const warped_references &refs,
+    const view *view0,
+    const int32_t *w,
+    const int32_t ncomponents) {
 
-    int32_t nr = view0->nr;
-    int32_t nc = view0->nc;
-    int32_t n_views = view0->n_references;
+    const int32_t MMM = 1 << view0->n_references;
+    const int32_t N_LS = MMM*view0->n_references;
+    const int32_t nrnc = view0->nr*view0->nc;
 
-    double *LSw = view0->merge_weights_double;
+    const uint16_t *seg_vp = view0->seg_vp;
 
-    uint16_t *seg_vp = view0->seg_vp;
+    const __m256i vnone = _mm256_set1_epi32(-1);
+    const __m256i vlast = _mm256_set1_epi32(nrnc - 1);
+    const __m256i vlow16 = _mm256_set1_epi32(0xFFFF);
+    const __m256i vhalf = _mm256_set1_epi32(1 << (BIT_DEPTH_MERGE - 1));
+    const __m256i vmax = _mm256_set1_epi32((1 << BIT_DEPTH) - 1);
+    const __m256i vzero = _mm256_setzero_si256();
 
-    double *AA1 = new double[nr * nc]();
-    uint16_t *AA2 = new uint16_t[nr * nc]();
+    int32_t ii = 0;
 
-    for (int32_t ii = 0; ii < nr * nc; ii++) {
+    for (; ii + 8 <= nrnc; ii += 8) {
+
+        const __m256i vci = _mm256_cvtepu16_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(seg_vp + ii)));
+
+        for (int32_t icomp = 0; icomp < ncomponents; icomp++) {
+
+            __m256i S = vzero;
+
+            if (icomp < refs.ncomp) {
+
+                for (int32_t ik = 0; ik < view0->n_references; ik++) {
+
+                    const __m256i vw = _mm256_i32gather_epi32(
+                        w + icomp*N_LS + ik*MMM,
+                        vci,
+                        4);
+
+                    const __m256i vsrc = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(
+                            refs.source.data() +
+                            static_cast<size_t>(ik)*nrnc + ii));
+
+                    const uint16_t *plane = refs.textures[ik] + icomp*nrnc;
+
+                    /* 32-bit gathers of 16-bit samples, the last sample of
+                    the plane is broadcast instead so the gather never reads
+                    past the texture */
+                    const __m256i is_last = _mm256_cmpeq_epi32(vsrc, vlast);
+                    const __m256i gather_mask = _mm256_andnot_si256(
+                        _mm256_or_si256(_mm256_cmpeq_epi32(vsrc, vnone), is_last),
+                        vnone);
 
-        int32_t ci = seg_vp[ii]; /* occlusion class index and row index in thetas */
+                    __m256i vc = _mm256_mask_i32gather_epi32(
+                        vzero,
+                        reinterpret_cast<const int*>(plane),
+                        vsrc,
+                        gather_mask,
+                        2);
 
-        for (int32_t ik = 0; ik < n_views; ik++) {
-            uint16_t *ps = warpedColorViews[ik];
-            AA1[ii] +=
-                LSw[ci + ik * MMM] * ((double)(*(ps + ii + icomp * nr * nc)));
+                    vc = _mm256_and_si256(vc, vlow16);
+                    vc = _mm256_blendv_epi8(
+                        vc,
+                        _mm256_set1_epi32(plane[nrnc - 1]),
+                        is_last);
+
+                    S = _mm256_add_epi32(S, _mm256_mullo_epi32(vw, vc));
+                }
+            }
+
+            __m256i v = _mm256_srai_epi32(
+                _mm256_add_epi32(S, vhalf),
+                BIT_DEPTH_MERGE);
+
+            v = _mm256_min_epi32(_mm256_max_epi32(v, vzero), vmax);
+
+            _mm_storeu_si128(
+                reinterpret_cast<__m128i*>(view0->color + ii + icomp*nrnc),
+                _mm_packus_epi32(
+                    _mm256_castsi256_si128(v),
+                    _mm256_extracti128_si256(v, 1)));
         }
+    }
+
+    return ii;
+}
+#endif
 
-        if (AA1[ii] < 0)
-            AA1[ii] = 0;
-        if (AA1[ii] > (1 << BIT_DEPTH) - 1)
-            AA1[ii] = (1 << BIT_DEPTH) - 1;
+void mergeWarped_N(
+    const warped_references &refs,
+    view *view0,
+    const int32_t ncomponents) {
 
-        AA2[ii] = (uint16_t)(floor(AA1[ii] + 0.5));
+    int32_t MMM = 1 << view0->n_references;  // pow(2, (view0)->n_references);
 
+    int32_t N_LS = MMM*view0->n_references;
+
+    bool *bmask = view0->bmask;
+
+    /* weights of all components in units of 2^-BIT_DEPTH_MERGE,
+    w[ci + ik*MMM + icomp*N_LS] */
+    std::vector<int32_t> w(N_LS*ncomponents);
+
+    for (int32_t icomp = 0; icomp < ncomponents; icomp++) {
+
+        int32_t uu = icomp*((MMM*view0->n_references) / 2);
+
+        for (int32_t ii = 0; ii < N_LS; ii++) {
+            w[ii + icomp*N_LS] =
+                bmask[ii] ? view0->merge_weights[uu++] : 0;
+        }
     }
 
-    memcpy(
-        view0->color + icomp*nr*nc,
-        AA2,
-        sizeof(uint16_t) * nr * nc);
+    int32_t first = 0;
+
+#ifdef MERGE_AVX2
+    first = mergeWarped_N_avx2(refs, view0, w.data(), ncomponents);
+#endif
 
-    delete[](AA1);
-    delete[](AA2);
+    mergeWarped_N_scalar(
+        refs,
+        view0,
+        w.data(),
+        ncomponents,
+        first,
+        view0->nr*view0->nc);
 
 }
 
 void getViewMergingLSWeights_icomp(
     view *view0,
-    uint16_t **warpedColorViews,
+    const warped_references &refs,
     const uint16_t *original_color_view,
     const int32_t icomp) {
 
@@ -282,59 +390,60 @@ void getViewMergingLSWeights_icomp(
 
     uint16_t *seg_vp = (view0)->seg_vp;
 
-    /* go through all regions, collect regressors from references */
-    uint16_t **reference_view_pixels_in_classes = new uint16_t*[MMM
-        * n_references]();
+    /* normal equations of all classes in one pass over the pixels, for
+    class ij the regressors are the references available in it. The sums
+    are exact in integers, A'A of class ij is at phi[ij*n_references^2]
+    (upper triangle), A'y at psi[ij*n_references] and y'y at yy[ij]. */
 
-    /* also collect desired values */
-    uint16_t **original_view_in_classes = new uint16_t*[MMM]();
+    const int32_t MT = n_references;
 
-    int32_t *number_of_pixels_per_region = (view0)->number_of_pixels_per_region;
+    std::vector<uint64_t> phi(static_cast<size_t>(MMM)*MT*MT);
+    std::vector<uint64_t> psi(static_cast<size_t>(MMM)*MT);
+    std::vector<uint64_t> yy(MMM);
 
-    for (int32_t ij = 1; ij < MMM; ij++) {  // region
+    std::vector<uint64_t> x(MT);
+
+    for (int32_t ii = 0; ii < nr * nc; ii++) {
 
-        int32_t NN = number_of_pixels_per_region[ij];
+        const int32_t ci = seg_vp[ii];
 
-        original_view_in_classes[ij] = new uint16_t[NN]();
-        uint16_t *p3s = original_view_in_classes[ij];
+        if (ci == 0) {
+            continue;
+        }
 
-        int32_t jj = 0;
+        int32_t M = 0;
 
-        for (int32_t ii = 0; ii < nr * nc; ii++) {
-            if (seg_vp[ii] == ij) {
-                *(p3s + jj) = *(original_color_view + ii + icomp*nr*nc);
-                jj++;
+        for (int32_t ik = 0; ik < n_references; ik++) {
+            if (bmask[ci + ik * MMM]) {
+                x[M++] = refs.color(ik, ii, icomp);
             }
         }
 
-        for (int32_t ik = 0; ik < n_references; ik++) {  // reference view
-
-            if (bmask[ij + ik * MMM]) {
+        const uint64_t y = original_color_view[ii + icomp*nr*nc];
 
-                /* allocate pixels for region */
-                reference_view_pixels_in_classes[ij + ik * MMM] =
-                    new uint16_t[NN]();
+        uint64_t *phi_ci = phi.data() + static_cast<size_t>(ci)*MT*MT;
+        uint64_t *psi_ci = psi.data() + static_cast<size_t>(ci)*MT;
 
-                uint16_t *ps = reference_view_pixels_in_classes[ij + ik * MMM];
-                uint16_t *pss = warpedColorViews[ik];
+        for (int32_t ikk = 0; ikk < M; ikk++) {
 
-                jj = 0;
+            psi_ci[ikk] += x[ikk] * y;
 
-                for (int32_t ii = 0; ii < nr * nc; ii++) {
-                    if (seg_vp[ii] == ij) {
-                        *(ps + jj) = *(pss + ii + icomp*nr*nc);
-                        jj++;
-                    }
-                }
+            for (int32_t jkk = ikk; jkk < M; jkk++) {
+                phi_ci[ikk + jkk * MT] += x[ikk] * x[jkk];
             }
         }
+
+        yy[ci] += y * y;
     }
 
+    /* samples are scaled to [0,1] */
+    const double scale2 =
+        static_cast<double>((1 << BIT_DEPTH) - 1) *
+        static_cast<double>((1 << BIT_DEPTH) - 1);
+
     /* run fastOLS on the classes */
     int16_t *thetas = new int16_t[MMM * n_references]();
     for (int32_t ij = 1; ij < MMM; ij++) {
-        /* form A for this class, compute A'*A (phi)
-        also compute A'*y (psi), where y is the desired data from the original view */
 
         int32_t M = 0; /* number of active reference views for class ij */
 
@@ -343,51 +452,37 @@ void getViewMergingLSWeights_icomp(
                 M++;
         }
 
-        int32_t N = number_of_pixels_per_region[ij];  // number of rows in A
+        const uint64_t *phi_ij = phi.data() + static_cast<size_t>(ij)*MT*MT;
+        const uint64_t *psi_ij = psi.data() + static_cast<size_t>(ij)*MT;
 
-        double *AA = new double[N * M](); 
-        double *Yd = new double[N]();
+        std::vector<double> PHI(M*M);
+        std::vector<double> PSI(M);
 
-        uint16_t *ps;
+        for (int32_t ikk = 0; ikk < M; ikk++) {
 
-        int32_t ikk = 0;
+            PSI[ikk] = static_cast<double>(psi_ij[ikk]) / scale2;
 
-        for (int32_t ik = 0; ik < n_references; ik++) {
-            if (bmask[ij + ik * MMM]) {
-                ps = reference_view_pixels_in_classes[ij + ik * MMM];
-                for (int32_t ii = 0; ii < N; ii++) {
-                    *(AA + ii + ikk * N) = ((double) *(ps + ii))
-                        / (double)((1 << BIT_DEPTH) - 1);
-                }
-                ikk++;
+            for (int32_t jkk = ikk; jkk < M; jkk++) {
+                PHI[ikk + jkk * M] =
+                    static_cast<double>(phi_ij[ikk + jkk * MT]) / scale2;
+                PHI[jkk + ikk * M] = PHI[ikk + jkk * M];
             }
         }
 
-        ps = original_view_in_classes[ij];
-
-        for (int32_t ii = 0; ii < N; ii++) {
-            *(Yd + ii) = ((double) *(ps + ii))
-                / (double)((1 << BIT_DEPTH) - 1);
-        }
+        const double yd2 = static_cast<double>(yy[ij]) / scale2;
 
         /* fastols */
 
         int32_t *PredRegr0 = new int32_t[M]();
         double *PredTheta0 = new double[M]();
 
-        int32_t Mtrue = FastOLS_new(
-            &AA,
-            &Yd,
+        int32_t Mtrue = FastOLS_gram(
+            PHI.data(),
+            PSI.data(),
+            yd2,
             PredRegr0,
             PredTheta0,
-            M, M, M, N);
-
-        if (AA != nullptr) {
-            delete[](AA);
-        }
-        if (Yd != nullptr) {
-            delete[](Yd);
-        }
+            M, M, M);
 
         /* establish the subset of reference views available for class */
         int32_t *iks = new int32_t[M]();
@@ -428,19 +523,6 @@ void getViewMergingLSWeights_icomp(
 
     delete[](thetas);
 
-    for (int32_t ij = 0; ij < MMM; ij++) {
-
-        delete[](original_view_in_classes[ij]);
-
-        for (int32_t ik = 0; ik < n_references; ik++) {
-            delete[](reference_view_pixels_in_classes[ij + MMM * ik]);
-        }
-
-    }
-
-    delete[](original_view_in_classes);
-    delete[](reference_view_pixels_in_classes);
-
 }
 
 void getGeomWeight_icomp(
@@ -27,47 +27,76 @@
 #ifndef MERGING_HH
 #define MERGING_HH
 
+#include <vector>
+
 #include "view.hh"
+#include "warping.hh"
+
+/* References of a view forward warped in compact form, per reference and
+pixel of the view the reference pixel which wins it (see
+warpView0_to_View1_source). The colour is read from the decoded reference
+textures, no warped copies of the references are made. */
+struct warped_references {
+
+    int32_t nrnc = 0;
+    int32_t ncomp = 0;
+
+    /* decoded reference textures, kept pinned until merged */
+    std::vector<const uint16_t*> textures;
+
+    /* n_references x nrnc */
+    std::vector<uint32_t> source;
+
+    bool available(const int32_t ik, const int32_t ii) const {
+        return source[ii + ik*nrnc] != WARP_NO_SOURCE;
+    }
+
+    /* warped colour of reference ik, 0 where not available */
+    uint16_t color(
+        const int32_t ik,
+        const int32_t ii,
+        const int32_t icomp) const {
 
-void init_warping_arrays(
+        const uint32_t ij = source[ii + ik*nrnc];
+
+        return ij == WARP_NO_SOURCE || icomp >= ncomp ?
+            0 :
+            textures[ik][ij + icomp*nrnc];
+    }
+
+};
+
+void init_warped_references(
     const int32_t N,
-    uint16_t **&warped_texture_views,
-    uint16_t **&warped_depth_views,
-    float **&DispTargs,
     const int32_t nr,
     const int32_t nc,
-    const int32_t ncomp);
-
-void clean_warping_arrays(
-    const int32_t N,
-    uint16_t **warped_texture_views,
-    uint16_t **warped_depth_views,
-    float **DispTargs);
+    const int32_t ncomp,
+    warped_references &refs);
 
 void setBMask(view *view0);
 
 void initSegVp(
     view *view0, 
-    float **DispTargs);
+    const warped_references &refs);
 
 void initViewW(
     view *view0, 
-    float **DispTargs);
+    const warped_references &refs);
 
 void mergeMedian_N(
-    uint16_t **warpedColorViews, 
-    float **DispTargs,  
+    const warped_references &refs,
     view *view0, 
     const int32_t ncomponents);
 
-void mergeWarped_N_icomp(
-    uint16_t **warpedColorViews,
+/* blends components 0..ncomponents-1 with the merge weights in one pass */
+void mergeWarped_N(
+    const warped_references &refs,
     view *view0,
-    const int32_t icomp);
+    const int32_t ncomponents);
 
 void getViewMergingLSWeights_icomp(
     view *view0,
-    uint16_t **warpedColorViews,
+    const warped_references &refs,
     const uint16_t *original_color_view,
     const int32_t icomp);
 
@@ -0,0 +1,136 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "planar.hh"
+
+#include <cstdio>
+#include <cstring>
+
+#define IO_V false
+
+bool aux_map16planar(
+    const char* filename,
+    int32_t &width,
+    int32_t &height,
+    int32_t &ncomp,
+    aux_mapped_file &mfile,
+    const uint16_t *&img) {
+
+    if (IO_V)
+        printf("Mapping %s\n", filename);
+
+    if (!aux_map_file(filename, mfile)) {
+        printf("%s does not exist\n", filename);
+        return false;
+    }
+
+    int32_t dims[3];
+
+    if (mfile.size < PLANAR_HEADER_BYTES ||
+        memcmp(mfile.data, PLANAR_MAGIC, 4))
+    {
+        printf("ERROR %s is not a raw planar image\n", filename);
+        aux_unmap_file(mfile);
+        return false;
+    }
+
+    memcpy(dims, mfile.data + 4, sizeof(dims));
+
+    width = dims[0];
+    height = dims[1];
+    ncomp = dims[2];
+
+    const size_t nbytes =
+        static_cast<size_t>(width) * height * ncomp * sizeof(uint16_t);
+
+    if (mfile.size < PLANAR_HEADER_BYTES + nbytes) {
+        fprintf(stderr, "READ ERROR aux_map16planar() %s\n", filename);
+        aux_unmap_file(mfile);
+        return false;
+    }
+
+    img = reinterpret_cast<const uint16_t*>(mfile.data + PLANAR_HEADER_BYTES);
+
+    return true;
+}
+
+bool aux_read16planar(
+    const char* filename,
+    int32_t &width,
+    int32_t &height,
+    int32_t &ncomp,
+    uint16_t *&img) {
+
+    aux_mapped_file mfile;
+    const uint16_t *mapped_img;
+
+    if (!aux_map16planar(filename, width, height, ncomp, mfile, mapped_img)) {
+        return false;
+    }
+
+    const size_t nvalues = static_cast<size_t>(width) * height * ncomp;
+
+    img = new uint16_t[nvalues];
+
+    memcpy(img, mapped_img, nvalues * sizeof(uint16_t));
+
+    aux_unmap_file(mfile);
+
+    return true;
+}
+
+bool aux_write16planar(
+    const char* filename,
+    const int32_t width,
+    const int32_t height,
+    const int32_t ncomp,
+    const uint16_t *img) {
+
+    aux_ensure_directory(filename);
+
+    if (IO_V)
+        printf("Writing %s\n", filename);
+
+    const size_t nbytes =
+        static_cast<size_t>(width) * height * ncomp * sizeof(uint16_t);
+
+    aux_mapped_file mfile;
+
+    if (!aux_map_file_write(filename, PLANAR_HEADER_BYTES + nbytes, mfile)) {
+        printf("Cannot open %s\n", filename);
+        return false;
+    }
+
+    const int32_t dims[3] = { width, height, ncomp };
+
+    memcpy(mfile.data, PLANAR_MAGIC, 4);
+    memcpy(mfile.data + 4, dims, sizeof(dims));
+    memcpy(mfile.data + PLANAR_HEADER_BYTES, img, nbytes);
+
+    aux_unmap_file(mfile);
+
+    return true;
+}
@@ -0,0 +1,79 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PLANAR_HH
+#define PLANAR_HH
+
+#include <cstdint>
+
+#include "fileaux.hh"
+
+using std::int32_t;
+using std::uint32_t;
+
+using std::int16_t;
+using std::uint16_t;
+
+using std::int8_t;
+using std::uint8_t;
+
+/* Raw planar format for intermediate images which never leave the codec.
+The file is a 16 byte header followed by the image exactly as it is kept in
+memory: uint16_t in native byte order, column-major, one plane after the
+other (row + col*height + icomp*height*width). Header is
+
+    "WRAW" | int32_t width | int32_t height | int32_t ncomp
+
+so the data is 16-byte aligned in the file and in a mapping of it. */
+
+#define PLANAR_MAGIC "WRAW"
+#define PLANAR_HEADER_BYTES 16
+
+bool aux_read16planar(
+    const char* filename,
+    int32_t &width,
+    int32_t &height,
+    int32_t &ncomp,
+    uint16_t *&img);
+
+bool aux_write16planar(
+    const char* filename,
+    const int32_t width,
+    const int32_t height,
+    const int32_t ncomp,
+    const uint16_t *img);
+
+/* maps the file read-only, img points into the mapping and is valid until
+aux_unmap_file(mfile) */
+bool aux_map16planar(
+    const char* filename,
+    int32_t &width,
+    int32_t &height,
+    int32_t &ncomp,
+    aux_mapped_file &mfile,
+    const uint16_t *&img);
+
+#endif
@@ -29,9 +29,467 @@
 
 #include <cstdio>
 #include <cstring>
+#include <cctype>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PPM_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define PPM_AVX2
+#include <immintrin.h>
+#endif
 
 #define IO_V false
 
+/* Data of a 16bit .ppm/.pgm is big-endian, interleaved and row-major, while
+images in memory are planar and column-major. Conversion between the two is
+a transpose of a row of ncomp*width values, done on tiles of 8 rows by 8
+(SSE2) or 16 (AVX2) pixels with register transposes, so that both sides are
+accessed in short contiguous runs. Tiles are visited in bands of
+PPM_BAND_ROWS rows to keep the rows of the band in cache. */
+
+#define PPM_BAND_ROWS 64
+
+static inline uint16_t swap16(const uint16_t val) {
+    return static_cast<uint16_t>((val << 8) | (val >> 8));
+}
+
+#ifdef PPM_SSE2
+
+static inline __m128i swap16_sse2(const __m128i val) {
+    return _mm_or_si128(_mm_slli_epi16(val, 8), _mm_srli_epi16(val, 8));
+}
+
+/* in-place transpose of 8x8 16bit values, r[i] is row i */
+static inline void transpose8x8_epi16(__m128i *r) {
+
+    __m128i t0 = _mm_unpacklo_epi16(r[0], r[1]);
+    __m128i t1 = _mm_unpackhi_epi16(r[0], r[1]);
+    __m128i t2 = _mm_unpacklo_epi16(r[2], r[3]);
+    __m128i t3 = _mm_unpackhi_epi16(r[2], r[3]);
+    __m128i t4 = _mm_unpacklo_epi16(r[4], r[5]);
+    __m128i t5 = _mm_unpackhi_epi16(r[4], r[5]);
+    __m128i t6 = _mm_unpacklo_epi16(r[6], r[7]);
+    __m128i t7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+    __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+    __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+    __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+    __m128i u3 = _mm_unpackhi_epi32(t1, t3);
+    __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+    __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+    __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+    __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+
+    r[0] = _mm_unpacklo_epi64(u0, u4);
+    r[1] = _mm_unpackhi_epi64(u0, u4);
+    r[2] = _mm_unpacklo_epi64(u1, u5);
+    r[3] = _mm_unpackhi_epi64(u1, u5);
+    r[4] = _mm_unpacklo_epi64(u2, u6);
+    r[5] = _mm_unpackhi_epi64(u2, u6);
+    r[6] = _mm_unpacklo_epi64(u3, u7);
+    r[7] = _mm_unpackhi_epi64(u3, u7);
+}
+
+/* file tile of 8 rows x 8 pixels (x0,y0) -> planar image. In each row the
+8*NCOMP values are transposed in blocks of 8, value v of the row is
+component v%NCOMP of pixel x0+v/NCOMP. */
+template<int32_t NCOMP>
+static inline void tile_to_planar_sse2(
+    const uint16_t *src,
+    uint16_t *dst,
+    const int32_t width,
+    const int32_t height,
+    const int32_t x0,
+    const int32_t y0) {
+
+    const size_t row_stride = static_cast<size_t>(width) * NCOMP;
+    const size_t plane = static_cast<size_t>(width) * height;
+
+    for (int32_t ib = 0; ib < NCOMP; ib++) {
+
+        __m128i r[8];
+
+        for (int32_t ii = 0; ii < 8; ii++) {
+            r[ii] = swap16_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                src + (y0 + ii)*row_stride + x0*NCOMP + 8 * ib)));
+        }
+
+        transpose8x8_epi16(r);
+
+        for (int32_t ik = 0; ik < 8; ik++) {
+            const int32_t v = 8 * ib + ik;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(
+                dst + y0 + static_cast<size_t>(x0 + v / NCOMP)*height + (v % NCOMP)*plane),
+                r[ik]);
+        }
+    }
+}
+
+/* planar image -> file tile of 8 rows x 8 pixels, mirror of the above */
+template<int32_t NCOMP>
+static inline void planar_to_tile_sse2(
+    const uint16_t *src,
+    uint16_t *dst,
+    const int32_t width,
+    const int32_t height,
+    const int32_t x0,
+    const int32_t y0) {
+
+    const size_t row_stride = static_cast<size_t>(width) * NCOMP;
+    const size_t plane = static_cast<size_t>(width) * height;
+
+    for (int32_t ib = 0; ib < NCOMP; ib++) {
+
+        __m128i r[8];
+
+        for (int32_t ik = 0; ik < 8; ik++) {
+            const int32_t v = 8 * ib + ik;
+            r[ik] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                src + y0 + static_cast<size_t>(x0 + v / NCOMP)*height + (v % NCOMP)*plane));
+        }
+
+        transpose8x8_epi16(r);
+
+        for (int32_t ii = 0; ii < 8; ii++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(
+                dst + (y0 + ii)*row_stride + x0*NCOMP + 8 * ib),
+                swap16_sse2(r[ii]));
+        }
+    }
+}
+
+#endif
+
+#ifdef PPM_AVX2
+
+static inline __m256i swap16_avx2(const __m256i val) {
+    const __m256i mask = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    return _mm256_shuffle_epi8(val, mask);
+}
+
+/* two independent 8x8 transposes, one per 128bit lane */
+static inline void transpose8x8x2_epi16(__m256i *r) {
+
+    __m256i t0 = _mm256_unpacklo_epi16(r[0], r[1]);
+    __m256i t1 = _mm256_unpackhi_epi16(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi16(r[2], r[3]);
+    __m256i t3 = _mm256_unpackhi_epi16(r[2], r[3]);
+    __m256i t4 = _mm256_unpacklo_epi16(r[4], r[5]);
+    __m256i t5 = _mm256_unpackhi_epi16(r[4], r[5]);
+    __m256i t6 = _mm256_unpacklo_epi16(r[6], r[7]);
+    __m256i t7 = _mm256_unpackhi_epi16(r[6], r[7]);
+
+    __m256i u0 = _mm256_unpacklo_epi32(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi32(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi32(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi32(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi32(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi32(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi32(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi32(t5, t7);
+
+    r[0] = _mm256_unpacklo_epi64(u0, u4);
+    r[1] = _mm256_unpackhi_epi64(u0, u4);
+    r[2] = _mm256_unpacklo_epi64(u1, u5);
+    r[3] = _mm256_unpackhi_epi64(u1, u5);
+    r[4] = _mm256_unpacklo_epi64(u2, u6);
+    r[5] = _mm256_unpackhi_epi64(u2, u6);
+    r[6] = _mm256_unpacklo_epi64(u3, u7);
+    r[7] = _mm256_unpackhi_epi64(u3, u7);
+}
+
+/* file tile of 8 rows x 16 pixels -> planar image, each 256bit load holds
+values 16*ib..16*ib+15 of the row, low lane the first 8 */
+template<int32_t NCOMP>
+static inline void tile_to_planar_avx2(
+    const uint16_t *src,
+    uint16_t *dst,
+    const int32_t width,
+    const int32_t height,
+    const int32_t x0,
+    const int32_t y0) {
+
+    const size_t row_stride = static_cast<size_t>(width) * NCOMP;
+    const size_t plane = static_cast<size_t>(width) * height;
+
+    for (int32_t ib = 0; ib < NCOMP; ib++) {
+
+        __m256i r[8];
+
+        for (int32_t ii = 0; ii < 8; ii++) {
+            r[ii] = swap16_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+                src + (y0 + ii)*row_stride + x0*NCOMP + 16 * ib)));
+        }
+
+        transpose8x8x2_epi16(r);
+
+        for (int32_t ik = 0; ik < 8; ik++) {
+
+            const int32_t v0 = 16 * ib + ik;
+            const int32_t v1 = v0 + 8;
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(
+                dst + y0 + static_cast<size_t>(x0 + v0 / NCOMP)*height + (v0 % NCOMP)*plane),
+                _mm256_castsi256_si128(r[ik]));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(
+                dst + y0 + static_cast<size_t>(x0 + v1 / NCOMP)*height + (v1 % NCOMP)*plane),
+                _mm256_extracti128_si256(r[ik], 1));
+        }
+    }
+}
+
+/* planar image -> file tile of 8 rows x 16 pixels, mirror of the above */
+template<int32_t NCOMP>
+static inline void planar_to_tile_avx2(
+    const uint16_t *src,
+    uint16_t *dst,
+    const int32_t width,
+    const int32_t height,
+    const int32_t x0,
+    const int32_t y0) {
+
+    const size_t row_stride = static_cast<size_t>(width) * NCOMP;
+    const size_t plane = static_cast<size_t>(width) * height;
+
+    for (int32_t ib = 0; ib < NCOMP; ib++) {
+
+        __m256i r[8];
+
+        for (int32_t ik = 0; ik < 8; ik++) {
+
+            const int32_t v0 = 16 * ib + ik;
+            const int32_t v1 = v0 + 8;
+
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                src + y0 + static_cast<size_t>(x0 + v0 / NCOMP)*height + (v0 % NCOMP)*plane));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                src + y0 + static_cast<size_t>(x0 + v1 / NCOMP)*height + (v1 % NCOMP)*plane));
+
+            r[ik] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        }
+
+        transpose8x8x2_epi16(r);
+
+        for (int32_t ii = 0; ii < 8; ii++) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(
+                dst + (y0 + ii)*row_stride + x0*NCOMP + 16 * ib),
+                swap16_avx2(r[ii]));
+        }
+    }
+}
+
+#endif
+
+/* file data (src) -> planar image (dst) */
+template<int32_t NCOMP>
+static void interleaved_to_planar(
+    const uint16_t *src,
+    uint16_t *dst,
+    const int32_t width,
+    const int32_t height) {
+
+    const int32_t height8 = height - height % 8;
+
+    int32_t xdone = 0; /* columns [0,xdone) handled by the tile kernels */
+
+    for (int32_t yb = 0; yb < height8; yb += PPM_BAND_ROWS) {
+
+        const int32_t yend = yb + PPM_BAND_ROWS < height8 ? yb + PPM_BAND_ROWS : height8;
+
+        int32_t x0 = 0;
+
+#ifdef PPM_AVX2
+        for (; x0 + 16 <= width; x0 += 16) {
+            for (int32_t y0 = yb; y0 < yend; y0 += 8) {
+                tile_to_planar_avx2<NCOMP>(src, dst, width, height, x0, y0);
+            }
+        }
+#endif
+#ifdef PPM_SSE2
+        for (; x0 + 8 <= width; x0 += 8) {
+            for (int32_t y0 = yb; y0 < yend; y0 += 8) {
+                tile_to_planar_sse2<NCOMP>(src, dst, width, height, x0, y0);
+            }
+        }
+#endif
+        xdone = x0;
+    }
+
+    /* leftover columns and rows */
+    for (int32_t y = 0; y < height; y++) {
+
+        const int32_t xstart = y < height8 ? xdone : 0;
+
+        for (int32_t x = xstart; x < width; x++) {
+            for (int32_t icomp = 0; icomp < NCOMP; icomp++) {
+                dst[y + static_cast<size_t>(x)*height + icomp*static_cast<size_t>(width)*height] =
+                    swap16(src[(static_cast<size_t>(y)*width + x)*NCOMP + icomp]);
+            }
+        }
+    }
+}
+
+/* planar image (src) -> file data (dst) */
+template<int32_t NCOMP>
+static void planar_to_interleaved(
+    const uint16_t *src,
+    uint16_t *dst,
+    const int32_t width,
+    const int32_t height) {
+
+    const int32_t height8 = height - height % 8;
+
+    int32_t xdone = 0;
+
+    for (int32_t yb = 0; yb < height8; yb += PPM_BAND_ROWS) {
+
+        const int32_t yend = yb + PPM_BAND_ROWS < height8 ? yb + PPM_BAND_ROWS : height8;
+
+        int32_t x0 = 0;
+
+#ifdef PPM_AVX2
+        for (; x0 + 16 <= width; x0 += 16) {
+            for (int32_t y0 = yb; y0 < yend; y0 += 8) {
+                planar_to_tile_avx2<NCOMP>(src, dst, width, height, x0, y0);
+            }
+        }
+#endif
+#ifdef PPM_SSE2
+        for (; x0 + 8 <= width; x0 += 8) {
+            for (int32_t y0 = yb; y0 < yend; y0 += 8) {
+                planar_to_tile_sse2<NCOMP>(src, dst, width, height, x0, y0);
+            }
+        }
+#endif
+        xdone = x0;
+    }
+
+    for (int32_t y = 0; y < height; y++) {
+
+        const int32_t xstart = y < height8 ? xdone : 0;
+
+        for (int32_t x = xstart; x < width; x++) {
+            for (int32_t icomp = 0; icomp < NCOMP; icomp++) {
+                dst[(static_cast<size_t>(y)*width + x)*NCOMP + icomp] =
+                    swap16(src[y + static_cast<size_t>(x)*height + icomp*static_cast<size_t>(width)*height]);
+            }
+        }
+    }
+}
+
+/* bitwise OR of all samples, the maximum is > 1023 iff this is */
+static uint16_t or_reduce(const uint16_t *img, const size_t n) {
+
+    size_t i = 0;
+    uint16_t acc = 0;
+
+#if defined(PPM_AVX2)
+    __m256i vacc256 = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        vacc256 = _mm256_or_si256(
+            vacc256,
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(img + i)));
+    }
+    __m128i vacc = _mm_or_si128(
+        _mm256_castsi256_si128(vacc256),
+        _mm256_extracti128_si256(vacc256, 1));
+#elif defined(PPM_SSE2)
+    __m128i vacc = _mm_setzero_si128();
+#endif
+#ifdef PPM_SSE2
+    for (; i + 8 <= n; i += 8) {
+        vacc = _mm_or_si128(
+            vacc,
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(img + i)));
+    }
+    uint16_t lanes[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), vacc);
+    for (int32_t k = 0; k < 8; k++) {
+        acc |= lanes[k];
+    }
+#endif
+
+    for (; i < n; i++) {
+        acc |= img[i];
+    }
+
+    return acc;
+}
+
+/* parses "P5/P6 <width> <height> <max>" and the single whitespace
+character after it, offset is set to the start of the pixel data */
+static bool parse_header(
+    const uint8_t *data,
+    const size_t size,
+    int32_t &width,
+    int32_t &height,
+    int32_t &ncomp,
+    size_t &offset) {
+
+    size_t pos = 0;
+
+    const uint8_t *tokens[4];
+    size_t lengths[4];
+
+    for (int32_t it = 0; it < 4; it++) {
+
+        while (pos < size && isspace(data[pos])) {
+            pos++;
+        }
+
+        tokens[it] = data + pos;
+
+        while (pos < size && !isspace(data[pos])) {
+            pos++;
+        }
+
+        lengths[it] = data + pos - tokens[it];
+
+        if (lengths[it] == 0 || lengths[it] > 31) {
+            return false;
+        }
+    }
+
+    if (pos >= size) {
+        return false;
+    }
+
+    char token[32];
+
+    memcpy(token, tokens[0], lengths[0]);
+    token[lengths[0]] = 0;
+
+    if (!strncmp(token, "P6", 2)) {
+        ncomp = 3;
+    }
+    else if (!strncmp(token, "P5", 2)) {
+        ncomp = 1;
+    }
+    else {
+        printf("ERROR NOT PGM OR PPM\n");
+        return false;
+    }
+
+    memcpy(token, tokens[1], lengths[1]);
+    token[lengths[1]] = 0;
+    width = atoi(token);
+
+    memcpy(token, tokens[2], lengths[2]);
+    token[lengths[2]] = 0;
+    height = atoi(token);
+
+    offset = pos + 1;
+
+    return true;
+}
+
 bool aux_read16PGMPPM(
     const char* filename, 
     int32_t &width, 
@@ -42,84 +500,40 @@ bool aux_read16PGMPPM(
   if (IO_V)
     printf("Reading %s\n", filename);
 
-  int32_t max, x, y;
-  int32_t red, green, blue;
-  char dummy[100];
-
-  uint16_t *Image16bit = nullptr;
-
-  FILE *filept;
+  aux_mapped_file mfile;
 
-  filept = fopen(filename, "rb");
-
-  if (filept == nullptr) {
+  if (!aux_map_file(filename, mfile)) {
     printf("%s does not exist\n", filename);
     return false;
   }
 
-  fscanf(filept, "%s", dummy);
-  fscanf(filept, "%d %d\n", &width, &height);
-  fscanf(filept, "%d", &max);
-  fgetc(filept);
+  size_t offset = 0;
 
-  if (!strncmp(dummy, "P6", 2)) {
-    ncomp = 3;
-  } else if (!strncmp(dummy, "P5", 2)) {
-    ncomp = 1;
-  } else {
-    printf("ERROR NOT PGM OR PPM\n");
+  if (!parse_header(mfile.data, mfile.size, width, height, ncomp, offset)) {
+    aux_unmap_file(mfile);
     return false;
   }
 
-  //std::cout << width << "\t" << height << "\n";
-
-  img = new uint16_t[width * height * ncomp]();
-
-  Image16bit = new uint16_t[width * height * ncomp]();
+  const size_t nvalues = static_cast<size_t>(width) * height * ncomp;
 
-  /*--< Read 16bit ppm image from filept >--*/
-  int32_t nread = (int32_t) fread(Image16bit, sizeof(uint16_t),
-                          width * height * ncomp, filept);
-
-  if (nread != width * height * ncomp) {
+  if (mfile.size < offset + nvalues * sizeof(uint16_t)) {
     fprintf(stderr, "READ ERROR aux_read16ppm() %s\n", filename);
-    delete[] (img);
-    delete[] (Image16bit);
+    aux_unmap_file(mfile);
     return false;
   }
 
-  fclose(filept);
-
-  int32_t i = 0;
-
-  for (x = 0; x < width; x++) {
-    for (y = 0; y < height; y++) {
-
-      red = Image16bit[(x + y * width) * ncomp];
-      if (ncomp == 3) {
-        green = Image16bit[(x + y * width) * ncomp + 1];
-        blue = Image16bit[(x + y * width) * ncomp + 2];
-      }
+  img = new uint16_t[nvalues]();
 
-      // Exhange upper 8bit and lower 8bit for Intel x86
-      red = ((red & 0x00ff) << 8) | ((red & 0xff00) >> 8);
-      if (ncomp == 3) {
-        green = ((green & 0x00ff) << 8) | ((green & 0xff00) >> 8);
-        blue = ((blue & 0x00ff) << 8) | ((blue & 0xff00) >> 8);
-      }
+  /* pixel data is not necessarily 2-byte aligned after the header */
+  const uint16_t *src = reinterpret_cast<const uint16_t*>(mfile.data + offset);
 
-      img[i] = red;
-      if (ncomp == 3) {
-        img[i + height * width] = green;
-        img[i + 2 * height * width] = blue;
-      }
-
-      i++;
-
-    }
+  if (ncomp == 3) {
+    interleaved_to_planar<3>(src, img, width, height);
+  } else {
+    interleaved_to_planar<1>(src, img, width, height);
   }
 
-  delete[] (Image16bit);
+  aux_unmap_file(mfile);
 
   return true;
 
@@ -137,76 +551,41 @@ bool aux_write16PGMPPM(
   if (IO_V)
     printf("Writing %s\n", filename);
 
-  uint8_t *p;
-  int32_t i, tmp, j;
+  const size_t nvalues = static_cast<size_t>(width) * height * ncomp;
 
-  uint16_t maxi = 0;
+  uint16_t maxi = or_reduce(img, nvalues) > 1023 ? 65535 : 1023;
 
-  FILE *filept;
+  char header[128];
 
-  filept = fopen(filename, "wb");
+  int32_t header_length = sprintf(
+      header,
+      "%s\n%d %d\n%d\n",
+      ncomp == 3 ? "P6" : "P5",
+      width,
+      height,
+      maxi);
 
-  if (filept == NULL) {
+  aux_mapped_file mfile;
+
+  if (!aux_map_file_write(
+      filename,
+      header_length + nvalues * sizeof(uint16_t),
+      mfile)) {
     printf("Cannot open %s\n", filename);
     return false;
   }
 
-  uint16_t* img16bit = new uint16_t[height * width * ncomp]();
-
-  int32_t lin_ind = 0;
-  for (j = 0; j < height; j++) {
-    for (i = 0; i < width; i++) {
-      img16bit[lin_ind] = img[j + i * height];
-      if (ncomp == 3) {
-        img16bit[lin_ind + 1] = img[j + i * height + width * height];
-        img16bit[lin_ind + 2] = img[j + i * height + 2 * width * height];
-        lin_ind = lin_ind + 3;
-      } else {
-        lin_ind = lin_ind + 1;
-      }
+  memcpy(mfile.data, header, header_length);
 
-    }
-  }
-
-  for (i = 0; i < width * height * ncomp; i++) {
-    if (*(img16bit + i) > maxi)
-      maxi = *(img16bit + i);
-  }
-
-  p = (uint8_t *) img16bit;
-  for (i = 0; i < width * height; i++) {
-    tmp = *p;
-    *p = *(p + 1);
-    *(p + 1) = tmp;
-    p += 2;
-    if (ncomp == 3) {
-      tmp = *p;
-      *p = *(p + 1);
-      *(p + 1) = tmp;
-      p += 2;
-      tmp = *p;
-      *p = *(p + 1);
-      *(p + 1) = tmp;
-      p += 2;
-    }
-  }
-
-  if (maxi > 1023)
-    maxi = 65535;
-  else
-    maxi = 1023;
+  uint16_t *dst = reinterpret_cast<uint16_t*>(mfile.data + header_length);
 
   if (ncomp == 3) {
-    fprintf(filept, "P6\n%d %d\n%d\n", width, height, maxi);
+    planar_to_interleaved<3>(img, dst, width, height);
   } else {
-    fprintf(filept, "P5\n%d %d\n%d\n", width, height, maxi);
+    planar_to_interleaved<1>(img, dst, width, height);
   }
 
-  fwrite(img16bit, sizeof(uint16_t), width * height * ncomp, filept);
-
-  fclose(filept);
-
-  delete[] (img16bit);
+  aux_unmap_file(mfile);
 
   return true;
 }
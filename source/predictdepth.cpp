@@ -30,9 +30,12 @@
 #include "ppm.hh"
 #include "inpainting.hh"
 #include "merging.hh"
+#include "viewcache.hh"
+#include "mediannetwork.hh"
 
 #include <ctime>
 #include <vector>
+#include <algorithm>
 #include <cstdint>
 
 using std::int32_t;
@@ -56,52 +59,33 @@ void WaSP_predict_depth(
             SAI->c,
             SAI->r);
 
-        uint16_t **warped_texture_views_0_N =
-            new uint16_t*[SAI->n_depth_references]();
-        uint16_t **warped_depth_views_0_N =
-            new uint16_t*[SAI->n_depth_references]();
-        float **DispTargs_0_N =
-            new float*[SAI->n_depth_references]();
-
-        init_warping_arrays(
-            SAI->n_depth_references,
-            warped_texture_views_0_N,
-            warped_depth_views_0_N,
-            DispTargs_0_N,
-            SAI->nr,
-            SAI->nc,
-            SAI->ncomp);
+        const int32_t nrnc = SAI->nr*SAI->nc;
+
+        /* warped normalized disparities of the references */
+        std::vector<uint16_t> warped_depth_views_0_N(
+            static_cast<size_t>(SAI->n_depth_references)*nrnc);
+        std::vector<uint8_t> available_0_N(
+            static_cast<size_t>(SAI->n_depth_references)*nrnc);
 
         for (int32_t ij = 0; ij < SAI->n_depth_references; ij++) {
 
             view *ref_view = LF + SAI->depth_references[ij];
 
-            int32_t tmp_w, tmp_r, tmp_ncomp;
-
-            aux_read16PGMPPM(
-                ref_view->path_out_pgm,
-                tmp_w,
-                tmp_r,
-                tmp_ncomp,
-                ref_view->depth);
+            const uint16_t *ref_normdisp =
+                viewcache_acquire(ref_view, VIEWCACHE_NORMDISP);
 
-            ref_view->color = new uint16_t[ref_view->nr*ref_view->nc * 3]();
+            warp_table table;
 
-            //aux_read16PGMPPM(ref_view->path_out_ppm, tmp_w, tmp_r, tmp_ncomp,
-            //                 ref_view->color);
+            make_warp_table(ref_view, SAI, ref_normdisp, table);
 
-            warpView0_to_View1(
+            warpView0_to_View1_disparity(
                 ref_view,
-                SAI,
-                warped_texture_views_0_N[ij],
-                warped_depth_views_0_N[ij],
-                DispTargs_0_N[ij]);
+                table,
+                ref_normdisp,
+                warped_depth_views_0_N.data() + static_cast<size_t>(ij)*nrnc,
+                available_0_N.data() + static_cast<size_t>(ij)*nrnc);
 
-            delete[](ref_view->depth);
-            delete[](ref_view->color);
-
-            ref_view->depth = nullptr;
-            ref_view->color = nullptr;
+            viewcache_unpin(ref_view, VIEWCACHE_NORMDISP);
         }
 
         /* merge depth using median*/
@@ -110,21 +94,41 @@ void WaSP_predict_depth(
 
         double *hole_mask = new double[SAI->nr*SAI->nc]();
 
-        for (int32_t ij = 0; ij < SAI->nr * SAI->nc; ij++) {
+        const int32_t N = SAI->n_depth_references;
+
+        /* candidates of MEDIAN_NETWORK_LANES pixels at a time */
+        std::vector<uint16_t> candidates(N*MEDIAN_NETWORK_LANES);
+        int32_t count[MEDIAN_NETWORK_LANES];
+        uint16_t median[MEDIAN_NETWORK_LANES];
+
+        for (int32_t ij0 = 0; ij0 < nrnc; ij0 += MEDIAN_NETWORK_LANES) {
+
+            const int32_t n_lanes = std::min(MEDIAN_NETWORK_LANES, nrnc - ij0);
 
-            hole_mask[ij] = INIT_DISPARITY_VALUE;
+            for (int32_t p = 0; p < MEDIAN_NETWORK_LANES; p++) {
 
-            std::vector<uint16_t> depth_values;
-            for (int32_t uu = 0; uu < SAI->n_depth_references; uu++) {
-                uint16_t *pp = warped_depth_views_0_N[uu];
-                float *pf = DispTargs_0_N[uu];
-                if (*(pf + ij) > INIT_DISPARITY_VALUE) {
-                    depth_values.push_back(*(pp + ij));
+                count[p] = 0;
+
+                if (p < n_lanes) {
+                    for (int32_t uu = 0; uu < N; uu++) {
+                        if (available_0_N[ij0 + p + uu*nrnc]) {
+                            candidates[count[p]++ * MEDIAN_NETWORK_LANES + p] =
+                                warped_depth_views_0_N[ij0 + p + uu*nrnc];
+                        }
+                    }
                 }
             }
-            if (depth_values.size() > 0) {
-                SAI->depth[ij] = getMedian(depth_values);
-                hole_mask[ij] = 1.0f;
+
+            median_network(candidates.data(), count, N, median);
+
+            for (int32_t p = 0; p < n_lanes; p++) {
+
+                hole_mask[ij0 + p] = INIT_DISPARITY_VALUE;
+
+                if (count[p] > 0) {
+                    SAI->depth[ij0 + p] = median[p];
+                    hole_mask[ij0 + p] = 1.0f;
+                }
             }
         }
 
@@ -137,12 +141,6 @@ void WaSP_predict_depth(
 
         delete[](hole_mask);
 
-        clean_warping_arrays(
-            SAI->n_depth_references,
-            warped_texture_views_0_N,
-            warped_depth_views_0_N,
-            DispTargs_0_N);
-
     }
     else 
     {
@@ -0,0 +1,79 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "processpool.hh"
+
+process_pool::process_pool(const int32_t max_processes) :
+    max_processes(std::max(1, max_processes)) {
+}
+
+int32_t process_pool::add(std::function<int32_t()> job) {
+
+    jobs.push_back(std::move(job));
+
+    return static_cast<int32_t>(jobs.size()) - 1;
+
+}
+
+std::vector<int32_t> process_pool::run() {
+
+    const int32_t n_jobs = static_cast<int32_t>(jobs.size());
+
+    std::vector<int32_t> statuses(n_jobs, 0);
+
+    std::atomic<int32_t> next_job(0);
+
+    auto runner = [&]() {
+
+        int32_t ii;
+
+        while ((ii = next_job.fetch_add(1)) < n_jobs) {
+            statuses.at(ii) = jobs.at(ii)();
+        }
+
+    };
+
+    std::vector<std::thread> runners;
+
+    for (int32_t it = 1; it < std::min(max_processes, n_jobs); it++) {
+        runners.emplace_back(runner);
+    }
+
+    runner();
+
+    for (auto &t : runners) {
+        t.join();
+    }
+
+    jobs.clear();
+
+    return statuses;
+
+}
@@ -0,0 +1,63 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PROCESSPOOL_HH
+#define PROCESSPOOL_HH
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+using std::int32_t;
+using std::uint32_t;
+
+/* Bounded pool for runs of external codecs (kdu_compress, kdu_expand,
+TAppDecoder, ...). Jobs are queued as a batch and started in queue order,
+at most max_processes of them are running at any time. Each job is expected
+to block on its external process and return its exit status. */
+
+class process_pool {
+
+ private:
+
+    int32_t max_processes;
+
+    std::vector<std::function<int32_t()>> jobs;
+
+ public:
+
+    explicit process_pool(const int32_t max_processes);
+
+    /* returns the index of the job in the batch */
+    int32_t add(std::function<int32_t()> job);
+
+    /* runs the queued jobs and returns their statuses in queue order,
+    the queue is empty afterwards */
+    std::vector<int32_t> run();
+
+};
+
+#endif
@@ -0,0 +1,404 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+
+#include "ratecontrol.hh"
+
+int32_t interpolate_QP(
+    const std::vector<int32_t> &QPs,
+    const std::vector<double> &bpps,
+    const double target_bpp) {
+
+    /*use first one*/
+    if (bpps.size() == 1) {
+        return QPs.at(0);
+    }
+
+    /*use last one*/
+    if (*(bpps.end() - 1) > target_bpp) {
+        return *(QPs.end() - 1);
+    }
+
+    /*interpolate*/
+    double dx = *(bpps.end() - 1) - *(bpps.end() - 2);
+    double dy = QP_SEARCH_STEP;// *(QPs.end() - 1) - *(QPs.end() - 2);
+
+    double diffx = target_bpp - *(bpps.end() - 2);
+
+    return static_cast<int32_t>(
+        round(double(*(QPs.end() - 2) + diffx*(dy / dx))));
+
+}
+
+qp_search_result search_QP_linear(
+    const qp_probe &probe,
+    const double target_bpp,
+    const std::string &hevc_file,
+    const std::string &yuv_file) {
+
+    qp_search_result result;
+
+    for (int32_t QP = QP_SEARCH_MIN; QP <= QP_SEARCH_MAX; QP += QP_SEARCH_STEP) {
+
+        result.bpps.push_back(probe(QP, hevc_file, yuv_file));
+        result.QPs.push_back(QP);
+
+        if (*(result.bpps.end() - 1) < target_bpp) {
+            break;
+        }
+
+    }
+
+    result.QPfinal = interpolate_QP(result.QPs, result.bpps, target_bpp);
+
+    return result;
+
+}
+
+static std::string candidate_file(
+    const std::string &filename,
+    const int32_t QP) {
+
+    char suffix[64];
+    sprintf(suffix, ".qp%02d", QP);
+
+    return filename + suffix;
+
+}
+
+/* removes the temporary files of the probed QPs, except the bitstream
+coded at QPfinal */
+static void keep_candidate_at_QPfinal(
+    const std::vector<int32_t> &probed_QPs,
+    const std::string &hevc_file,
+    const std::string &yuv_file,
+    qp_search_result &result) {
+
+    for (int32_t QP : probed_QPs) {
+
+        std::string hevc_candidate = candidate_file(hevc_file, QP);
+
+        if (QP == result.QPfinal) {
+            result.hevc_at_QPfinal = hevc_candidate;
+        }
+        else {
+            remove(hevc_candidate.c_str());
+        }
+
+        remove(candidate_file(yuv_file, QP).c_str());
+
+    }
+
+}
+
+qp_search_result search_QP_parallel(
+    const qp_probe &probe,
+    const double target_bpp,
+    const std::string &hevc_file,
+    const std::string &yuv_file,
+    const int32_t n_parallel) {
+
+    std::vector<int32_t> candidates;
+
+    for (int32_t QP = QP_SEARCH_MIN; QP <= QP_SEARCH_MAX; QP += QP_SEARCH_STEP) {
+        candidates.push_back(QP);
+    }
+
+    const int32_t n_candidates = static_cast<int32_t>(candidates.size());
+
+    std::vector<double> bpps(n_candidates, 0.0);
+    std::vector<std::string> hevc_files(n_candidates);
+    std::vector<std::string> yuv_files(n_candidates);
+
+    for (int32_t ii = 0; ii < n_candidates; ii++) {
+        hevc_files.at(ii) = candidate_file(hevc_file, candidates.at(ii));
+        yuv_files.at(ii) = candidate_file(yuv_file, candidates.at(ii));
+    }
+
+    /* candidates are started in ascending QP order. Once some QP falls
+    below the target, no higher QP is started anymore, and the ones already
+    running are not used. */
+
+    std::mutex search_mutex;
+    int32_t next_candidate = 0;
+    int32_t first_in_range = n_candidates;
+
+    auto worker = [&]() {
+
+        while (true) {
+
+            int32_t ii;
+
+            {
+                std::lock_guard<std::mutex> lock(search_mutex);
+
+                if (next_candidate >= first_in_range) {
+                    return;
+                }
+
+                ii = next_candidate++;
+            }
+
+            double bpp = probe(
+                candidates.at(ii),
+                hevc_files.at(ii),
+                yuv_files.at(ii));
+
+            {
+                std::lock_guard<std::mutex> lock(search_mutex);
+
+                bpps.at(ii) = bpp;
+
+                if (bpp < target_bpp && ii < first_in_range) {
+                    first_in_range = ii;
+                }
+            }
+
+        }
+
+    };
+
+    std::vector<std::thread> workers;
+
+    for (int32_t it = 1; it < std::min(n_parallel, n_candidates); it++) {
+        workers.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto &t : workers) {
+        t.join();
+    }
+
+    /* every candidate up to first_in_range has been started (and
+    finished), so this is the sequence the linear search would probe */
+
+    const int32_t last = std::min(first_in_range, n_candidates - 1);
+
+    qp_search_result result;
+
+    result.QPs.assign(candidates.begin(), candidates.begin() + last + 1);
+    result.bpps.assign(bpps.begin(), bpps.begin() + last + 1);
+
+    result.QPfinal = interpolate_QP(result.QPs, result.bpps, target_bpp);
+
+    std::vector<int32_t> started(
+        candidates.begin(),
+        candidates.begin() + next_candidate);
+
+    keep_candidate_at_QPfinal(started, hevc_file, yuv_file, result);
+
+    return result;
+
+}
+
+/* QP where the line through (QP1,log bpp1) and (QP2,log bpp2) meets the
+target */
+static double secant_QP(
+    const int32_t QP1,
+    const double bpp1,
+    const int32_t QP2,
+    const double bpp2,
+    const double target_bpp) {
+
+    const double lr1 = log(std::max(bpp1, 1e-6));
+    const double lr2 = log(std::max(bpp2, 1e-6));
+
+    return QP1 + (log(target_bpp) - lr1) * double(QP2 - QP1) / (lr2 - lr1);
+
+}
+
+qp_search_result search_QP_model(
+    const qp_probe &probe,
+    const double target_bpp,
+    const std::string &hevc_file,
+    const std::string &yuv_file,
+    const int32_t seed_QP) {
+
+    std::vector<int32_t> probed_QPs;
+    std::vector<double> probed_bpps;
+
+    int32_t QP = seed_QP < 0 ? QP_MODEL_SEED : seed_QP;
+    QP = std::max(QP_SEARCH_MIN, std::min(QP_SEARCH_MAX, QP));
+
+    int32_t QPfinal = QP;
+
+    while (true) {
+
+        probed_bpps.push_back(probe(
+            QP,
+            candidate_file(hevc_file, QP),
+            candidate_file(yuv_file, QP)));
+        probed_QPs.push_back(QP);
+
+        const int32_t n_probes = static_cast<int32_t>(probed_QPs.size());
+
+        /* highest QP above the target rate, lowest QP below it */
+
+        int32_t above = -1;
+        int32_t below = -1;
+
+        for (int32_t ii = 0; ii < n_probes; ii++) {
+
+            if (probed_bpps.at(ii) >= target_bpp) {
+                if (above < 0 || probed_QPs.at(ii) > probed_QPs.at(above)) {
+                    above = ii;
+                }
+            }
+            else {
+                if (below < 0 || probed_QPs.at(ii) < probed_QPs.at(below)) {
+                    below = ii;
+                }
+            }
+
+        }
+
+        bool done = n_probes >= QP_MODEL_MAX_PROBES;
+
+        int32_t QPnext;
+
+        if (above >= 0 && below >= 0) {
+
+            const int32_t QPa = probed_QPs.at(above);
+            const int32_t QPb = probed_QPs.at(below);
+
+            /* rate is not monotonic in QP, take the lowest QP found
+            below the target */
+            if (QPa > QPb) {
+                QPfinal = QPb;
+                break;
+            }
+
+            QPnext = static_cast<int32_t>(round(secant_QP(
+                QPa,
+                probed_bpps.at(above),
+                QPb,
+                probed_bpps.at(below),
+                target_bpp)));
+
+            if (QPb - QPa <= QP_SEARCH_STEP) {
+                done = true;
+            }
+            else {
+                QPnext = std::max(QPa + 1, std::min(QPb - 1, QPnext));
+            }
+
+        }
+        else {
+
+            /* the target is not bracketed yet, extrapolate from the last two
+            probes or use the default slope */
+
+            const int32_t ref = above >= 0 ? above : below;
+
+            double QPmodel = probed_QPs.at(ref) +
+                (log(target_bpp) - log(std::max(probed_bpps.at(ref), 1e-6))) /
+                QP_MODEL_SLOPE;
+
+            if (n_probes > 1) {
+
+                const int32_t QP1 = probed_QPs.at(n_probes - 2);
+                const int32_t QP2 = probed_QPs.at(n_probes - 1);
+                const double bpp1 = probed_bpps.at(n_probes - 2);
+                const double bpp2 = probed_bpps.at(n_probes - 1);
+
+                if (QP1 != QP2 && (bpp2 - bpp1) / (QP2 - QP1) < 0) {
+                    QPmodel = secant_QP(QP1, bpp1, QP2, bpp2, target_bpp);
+                }
+
+            }
+
+            QPnext = static_cast<int32_t>(round(QPmodel));
+
+            if (above >= 0) {
+
+                if (probed_QPs.at(above) == QP_SEARCH_MAX) {
+                    QPnext = QP_SEARCH_MAX;
+                    done = true;
+                }
+                else {
+                    QPnext = std::max(
+                        probed_QPs.at(above) + 1,
+                        std::min(QP_SEARCH_MAX, QPnext));
+                }
+
+            }
+            else {
+
+                if (probed_QPs.at(below) == QP_SEARCH_MIN) {
+                    QPnext = QP_SEARCH_MIN;
+                    done = true;
+                }
+                else {
+                    QPnext = std::min(
+                        probed_QPs.at(below) - 1,
+                        std::max(QP_SEARCH_MIN, QPnext));
+                }
+
+            }
+
+        }
+
+        if (done) {
+            QPfinal = std::max(QP_SEARCH_MIN, std::min(QP_SEARCH_MAX, QPnext));
+            break;
+        }
+
+        QP = QPnext;
+
+    }
+
+    qp_search_result result;
+
+    const int32_t n_probed = static_cast<int32_t>(probed_QPs.size());
+
+    std::vector<int32_t> order(n_probed);
+
+    for (int32_t ii = 0; ii < n_probed; ii++) {
+        order.at(ii) = ii;
+    }
+
+    std::sort(order.begin(), order.end(), [&](int32_t a, int32_t b) {
+        return probed_QPs.at(a) < probed_QPs.at(b);
+    });
+
+    for (int32_t ii : order) {
+        result.QPs.push_back(probed_QPs.at(ii));
+        result.bpps.push_back(probed_bpps.at(ii));
+    }
+
+    result.QPfinal = QPfinal;
+
+    keep_candidate_at_QPfinal(probed_QPs, hevc_file, yuv_file, result);
+
+    return result;
+
+}
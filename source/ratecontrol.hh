@@ -0,0 +1,110 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RATECONTROL_HH
+#define RATECONTROL_HH
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <functional>
+
+using std::int32_t;
+using std::uint32_t;
+
+/* QPs probed by the residual rate control */
+#define QP_SEARCH_MIN 0
+#define QP_SEARCH_MAX 51
+#define QP_SEARCH_STEP 3
+
+/* model based search, first QP when nothing better is known, and the
+log-rate slope per QP assumed until two probes give a better one (rate
+halves about every 6 QP in HEVC) */
+#define QP_MODEL_SEED 30
+#define QP_MODEL_SLOPE -0.1155
+#define QP_MODEL_MAX_PROBES 6
+
+enum RATE_CONTROL {
+    RATE_CONTROL_LINEAR,
+    RATE_CONTROL_PARALLEL,
+    RATE_CONTROL_MODEL
+};
+
+/* codes the residual sequence at QP into hevc_file (reconstruction in
+yuv_file) and returns the rate in bits per pixel. May be called from
+several threads at once with distinct files. */
+typedef std::function<double(
+    const int32_t QP,
+    const std::string &hevc_file,
+    const std::string &yuv_file)> qp_probe;
+
+struct qp_search_result {
+
+    /* probed QPs in ascending order */
+    std::vector<int32_t> QPs;
+    std::vector<double> bpps;
+
+    int32_t QPfinal = 0;
+
+    /* bitstream already coded at QPfinal, empty if there is none */
+    std::string hevc_at_QPfinal;
+
+};
+
+/* QPfinal from the probed rates, interpolated between the last two */
+int32_t interpolate_QP(
+    const std::vector<int32_t> &QPs,
+    const std::vector<double> &bpps,
+    const double target_bpp);
+
+/* probes QPs one at a time, all probes write to hevc_file/yuv_file */
+qp_search_result search_QP_linear(
+    const qp_probe &probe,
+    const double target_bpp,
+    const std::string &hevc_file,
+    const std::string &yuv_file);
+
+/* probes up to n_parallel QPs at once, each into its own temporary files.
+Candidates above the first QP found below the target are not started,
+the result is identical to search_QP_linear. */
+qp_search_result search_QP_parallel(
+    const qp_probe &probe,
+    const double target_bpp,
+    const std::string &hevc_file,
+    const std::string &yuv_file,
+    const int32_t n_parallel);
+
+/* fits log(bpp) linearly in QP and moves toward the target by secant
+steps from seed_QP (< 0 for none), stops once the target is bracketed by
+QPs at most QP_SEARCH_STEP apart. Each probe has its own temporary files. */
+qp_search_result search_QP_model(
+    const qp_probe &probe,
+    const double target_bpp,
+    const std::string &hevc_file,
+    const std::string &yuv_file,
+    const int32_t seed_QP);
+
+#endif
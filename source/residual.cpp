@@ -36,6 +36,7 @@
 #include "fileaux.hh"
 #include "clip.hh"
 #include "medianfilter.hh"
+#include "codeccache.hh"
 
 #define USE_JP2_DICTIONARY 0 /*not usable with HEVC*/
 
@@ -736,7 +737,38 @@ long encodeHM(
         QP,
         yuvformatstr.c_str());
 
-    int32_t status = system_1(hm_call);
+    /* everything but the paths identifies the run */
+    char hm_parameters[512];
+
+    sprintf(hm_parameters,
+        "TAppEncoder"
+        " -fr %d"
+        " -wdt %d"
+        " -hgt %d"
+        " --FramesToBeEncoded=%d"
+        " --QP=%d"
+        " --ChromaFormatIDC=%s",
+        1,
+        nc,
+        nr,
+        nframes,
+        QP,
+        yuvformatstr.c_str());
+
+    const uint64_t key = codec_cache_key(
+        hm_encoder,
+        { input444, input_cfg },
+        hm_parameters);
+
+    if (!codec_cache_fetch(key, { output_hevc, outputYUV })) {
+
+        int32_t status = system_1(hm_call);
+
+        if (status == 0) {
+            codec_cache_store(key, { output_hevc, outputYUV });
+        }
+
+    }
 
     long filesize = aux_GetFileSize(std::string(output_hevc));
 
@@ -838,7 +870,22 @@ int32_t decodeHM(
         input_hevc,
         outputYUV);
 
-    return system_1(hm_call);
+    const uint64_t key = codec_cache_key(
+        hm_decoder,
+        { input_hevc },
+        "TAppDecoder");
+
+    if (codec_cache_fetch(key, { outputYUV })) {
+        return 0;
+    }
+
+    int32_t status = system_1(hm_call);
+
+    if (status == 0) {
+        codec_cache_store(key, { outputYUV });
+    }
+
+    return status;
 
 }
 
@@ -1120,7 +1167,25 @@ int32_t encodeKakadu(
         jp2_output_path,
         encoding_parameters);
 
-    return system_1(kdu_compress_s);
+    /* the input format follows from the extension */
+    const uint64_t key = codec_cache_key(
+        kdu_compress_path,
+        { ppm_pgm_input_path },
+        std::string("kdu_compress ") +
+        aux_extension(ppm_pgm_input_path) +
+        encoding_parameters);
+
+    if (codec_cache_fetch(key, { jp2_output_path })) {
+        return 0;
+    }
+
+    int32_t status = system_1(kdu_compress_s);
+
+    if (status == 0) {
+        codec_cache_store(key, { jp2_output_path });
+    }
+
+    return status;
 
 }
 
@@ -1145,7 +1210,24 @@ int32_t decodeKakadu(
         " -o ", 
         ppm_pgm_output_path);
 
-    return system_1(kdu_expand_s);
+    /* the output format follows from the extension */
+    const uint64_t key = codec_cache_key(
+        kdu_expand_path,
+        { jp2_input_path },
+        std::string("kdu_expand -precise ") +
+        aux_extension(ppm_pgm_output_path));
+
+    if (codec_cache_fetch(key, { ppm_pgm_output_path })) {
+        return 0;
+    }
+
+    int32_t status = system_1(kdu_expand_s);
+
+    if (status == 0) {
+        codec_cache_store(key, { ppm_pgm_output_path });
+    }
+
+    return status;
 
 }
 
@@ -1249,6 +1331,135 @@ uint16_t *apply_residual(
     return corrected;
 }
 
+bool open_decoded_residual_seq(
+    const char *inputYUV,
+    YUV_FORMAT input_yuv,
+    const int32_t nr1,
+    const int32_t nc1,
+    const int32_t nframes,
+    decoded_residual_seq &seq) {
+
+    seq.nr1 = nr1;
+    seq.nc1 = nc1;
+    seq.nframes = nframes;
+    seq.yuv_format = input_yuv;
+
+    if (input_yuv == YUV420) {
+
+        seq.YUV444_frames = convertYUV420seqTo444(
+            readYUV420_seq_from_disk(
+                inputYUV,
+                nframes,
+                nr1,
+                nc1),
+            nr1,
+            nc1,
+            nframes);
+
+        return true;
+    }
+
+    const size_t frame_size =
+        static_cast<size_t>(nr1)*nc1*(input_yuv == YUV444 ? 3 : 1);
+
+    if (!aux_map_file(inputYUV, seq.mfile) ||
+        seq.mfile.size < frame_size*nframes*sizeof(uint16_t))
+    {
+        printf("Decoded HEVC sequence %s not available\n", inputYUV);
+        aux_unmap_file(seq.mfile);
+        return false;
+    }
+
+    if (input_yuv == YUV400) {
+        seq.neutral_chroma.assign(nr1, 512);
+    }
+
+    return true;
+}
+
+void close_decoded_residual_seq(decoded_residual_seq &seq) {
+
+    aux_unmap_file(seq.mfile);
+
+    seq.YUV444_frames.clear();
+    seq.neutral_chroma.clear();
+    seq.nframes = 0;
+}
+
+residual_frame_view get_residual_frame(
+    const decoded_residual_seq &seq,
+    const int32_t frame) {
+
+    residual_frame_view fview;
+
+    const size_t plane_size = static_cast<size_t>(seq.nr1)*seq.nc1;
+
+    if (seq.yuv_format == YUV400) {
+
+        fview.plane[0] =
+            reinterpret_cast<const uint16_t*>(seq.mfile.data) + plane_size*frame;
+        fview.plane[1] = seq.neutral_chroma.data();
+        fview.plane[2] = seq.neutral_chroma.data();
+
+        fview.col_stride[0] = seq.nr1;
+        fview.col_stride[1] = 0;
+        fview.col_stride[2] = 0;
+
+        return fview;
+    }
+
+    const uint16_t *frame444 = seq.yuv_format == YUV444 ?
+        reinterpret_cast<const uint16_t*>(seq.mfile.data) + plane_size * 3 * frame :
+        seq.YUV444_frames.at(frame).data();
+
+    for (int32_t icomp = 0; icomp < 3; icomp++) {
+        fview.plane[icomp] = frame444 + plane_size*icomp;
+        fview.col_stride[icomp] = seq.nr1;
+    }
+
+    return fview;
+}
+
+void apply_residual_view(
+    uint16_t *image,
+    const residual_frame_view &qresidual,
+    const int32_t nr,
+    const int32_t nc,
+    const int32_t ncomp,
+    const int32_t bpc,
+    const int32_t Q_i,
+    const int32_t offset_i) {
+
+    double Q = static_cast<double>(Q_i);
+    double offset = static_cast<double>(offset_i);
+
+    uint16_t maxval = static_cast<uint16_t>((1 << bpc) - 1);
+
+    for (int32_t icomp = 0; icomp < ncomp; icomp++) {
+        for (int32_t ic = 0; ic < nc; ic++) {
+
+            const uint16_t *qres_col =
+                qresidual.plane[icomp] + ic*qresidual.col_stride[icomp];
+
+            uint16_t *image_col = image + ic*nr + nr*nc*icomp;
+
+            for (int32_t ir = 0; ir < nr; ir++) {
+
+                double residual = static_cast<double>(qres_col[ir]) * Q - offset;
+
+                double corrected_d = static_cast<double>(image_col[ir]) + residual;
+
+                corrected_d = floor(corrected_d + 0.5);
+
+                corrected_d = corrected_d > maxval ? maxval : corrected_d;
+                corrected_d = corrected_d < 0.0 ? 0.0 : corrected_d;
+
+                image_col[ir] = static_cast<uint16_t>(corrected_d);
+            }
+        }
+    }
+}
+
 uint16_t* decode_residual_JP2(
     const char *ppm_pgm_output_path,
     const char *kdu_expand_path,
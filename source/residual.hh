@@ -41,6 +41,7 @@ using std::int8_t;
 using std::uint8_t;
 
 #include "view.hh"
+#include "fileaux.hh"
 
 enum YUV_FORMAT {
     YUV444,
@@ -256,6 +257,61 @@ uint16_t *apply_residual(
     const int32_t ncomp,
     const int32_t bpc);
 
+/* Decoded HEVC texture residuals of one hierarchical level, one frame per
+view in the padded (nr1 x nc1) layout of the HM output. YUV444 and YUV400
+frames are read straight from a mapping of the decoder output (a YUV400
+frame gets the neutral chroma 512 for U and V), YUV420 is upsampled to 444
+in memory. */
+struct decoded_residual_seq {
+
+    int32_t nr1 = 0;
+    int32_t nc1 = 0;
+    int32_t nframes = 0;
+
+    YUV_FORMAT yuv_format = YUV444;
+
+    aux_mapped_file mfile;
+
+    std::vector<std::vector<uint16_t>> YUV444_frames; /* YUV420 only */
+    std::vector<uint16_t> neutral_chroma; /* YUV400 only, one column */
+
+};
+
+/* one frame of a decoded_residual_seq, sample (row, col) of component
+icomp is at plane[icomp][row + col*col_stride[icomp]] */
+struct residual_frame_view {
+
+    const uint16_t *plane[3];
+    int32_t col_stride[3];
+
+};
+
+bool open_decoded_residual_seq(
+    const char *inputYUV,
+    YUV_FORMAT input_yuv,
+    const int32_t nr1,
+    const int32_t nc1,
+    const int32_t nframes,
+    decoded_residual_seq &seq);
+
+void close_decoded_residual_seq(decoded_residual_seq &seq);
+
+residual_frame_view get_residual_frame(
+    const decoded_residual_seq &seq,
+    const int32_t frame);
+
+/* dequantizes the residual and adds it to image in place, same arithmetic
+as dequantize_residual() followed by apply_residual() */
+void apply_residual_view(
+    uint16_t *image,
+    const residual_frame_view &qresidual,
+    const int32_t nr,
+    const int32_t nc,
+    const int32_t ncomp,
+    const int32_t bpc,
+    const int32_t Q_i,
+    const int32_t offset_i);
+
 uint16_t* decode_residual_JP2(
     const char *ppm_pgm_output_path,
     const char *kdu_expand_path,
@@ -27,6 +27,7 @@
 #include "segmentation.hh"
 #include "medianfilter.hh"
 #include "ppm.hh"
+#include "viewcache.hh"
 
 #include <algorithm>
 #include <iterator>
@@ -42,25 +43,14 @@ segmentation makeSegmentation(
 
     if (n_seg_iterations > 0) {
 
-        delete[](SAI->depth);
-
-        int32_t tmp_w, tmp_r, tmp_ncomp;
-        aux_read16PGMPPM(
-            SAI->path_out_pgm,
-            tmp_w,
-            tmp_r,
-            tmp_ncomp,
-            SAI->depth);
-
         uint16_t *img16_padded =
             padArrayUint16_t(
-                SAI->depth,
+                viewcache_acquire(SAI, VIEWCACHE_NORMDISP),
                 SAI->nr,
                 SAI->nc,
                 SAI->NNt);
 
-        delete[](SAI->depth);
-        SAI->depth = nullptr;
+        viewcache_unpin(SAI, VIEWCACHE_NORMDISP);
 
         std::vector<uint16_t> img16_padded_v(
             img16_padded,
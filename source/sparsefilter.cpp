@@ -362,7 +362,7 @@ spfilter getGlobalSparseFilter_vec(
 }
 
 std::vector<uint16_t> padArrayUint16_t_vec(
-    uint16_t *input_image,
+    const uint16_t *input_image,
     const uint32_t nr,
     const uint32_t nc,
     const uint32_t NNt) {
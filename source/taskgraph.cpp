@@ -0,0 +1,215 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "taskgraph.hh"
+
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+task_graph::task_graph() : n_ready(0), n_remaining(0) {
+}
+
+int32_t task_graph::add_task(std::function<void()> work) {
+
+    task_node node;
+    node.work = work;
+
+    nodes.push_back(node);
+
+    return static_cast<int32_t>(nodes.size()) - 1;
+}
+
+int32_t task_graph::add_barrier(
+    const std::vector<int32_t> &joined,
+    std::function<void()> work) {
+
+    const int32_t id = add_task(work);
+
+    for (int32_t before : joined) {
+        add_dependency(before, id);
+    }
+
+    return id;
+}
+
+void task_graph::add_dependency(const int32_t before, const int32_t after) {
+
+    if (before >= after) {
+        /* tasks are added in an order in which they could run serially */
+        printf("task_graph: task %d cannot depend on task %d\n", after, before);
+        exit(0);
+    }
+
+    nodes.at(before).successors.push_back(after);
+    nodes.at(after).n_predecessors++;
+}
+
+int32_t task_graph::size() const {
+    return static_cast<int32_t>(nodes.size());
+}
+
+void task_graph::push_ready(const int32_t worker, const int32_t task) {
+
+    {
+        std::lock_guard<std::mutex> lock(deques.at(worker)->mutex);
+        deques.at(worker)->tasks.push_back(task);
+    }
+
+    n_ready++;
+
+    /* taking the mutex orders this with a worker going to sleep */
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    wakeup.notify_one();
+}
+
+bool task_graph::pop_ready(const int32_t worker, int32_t &task) {
+
+    const int32_t n_workers = static_cast<int32_t>(deques.size());
+
+    /* own deque, newest first */
+    {
+        worker_deque &own = *deques.at(worker);
+
+        std::lock_guard<std::mutex> lock(own.mutex);
+
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            n_ready--;
+            return true;
+        }
+    }
+
+    /* steal the oldest task of some other worker */
+    for (int32_t ii = 1; ii < n_workers; ii++) {
+
+        worker_deque &victim = *deques.at((worker + ii) % n_workers);
+
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            n_ready--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void task_graph::execute(const int32_t worker, const int32_t task) {
+
+    task_node &node = nodes.at(task);
+
+    if (node.work) {
+        node.work();
+    }
+
+    for (int32_t successor : node.successors) {
+        if (--pending[successor] == 0) {
+            push_ready(worker, successor);
+        }
+    }
+
+    if (--n_remaining == 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wakeup.notify_all();
+    }
+}
+
+void task_graph::worker_loop(const int32_t worker) {
+
+    while (true) {
+
+        int32_t task;
+
+        if (pop_ready(worker, task)) {
+            execute(worker, task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+
+        wakeup.wait(lock, [this] { return n_ready > 0 || n_remaining == 0; });
+
+        if (n_remaining == 0) {
+            break;
+        }
+    }
+}
+
+void task_graph::run(const int32_t n_threads) {
+
+    const int32_t n_tasks = size();
+    const int32_t n_workers = n_threads > 1 ? n_threads : 1;
+
+    if (n_tasks == 0) {
+        return;
+    }
+
+    pending.reset(new std::atomic<int32_t>[n_tasks]);
+
+    deques.clear();
+
+    for (int32_t ii = 0; ii < n_workers; ii++) {
+        deques.push_back(std::unique_ptr<worker_deque>(new worker_deque));
+    }
+
+    n_ready = 0;
+    n_remaining = n_tasks;
+
+    /* initially ready tasks are dealt out round robin, each deque is
+    popped from the back so they are pushed in reverse */
+    std::vector<int32_t> roots;
+
+    for (int32_t task = 0; task < n_tasks; task++) {
+        pending[task] = nodes.at(task).n_predecessors;
+        if (nodes.at(task).n_predecessors == 0) {
+            roots.push_back(task);
+        }
+    }
+
+    for (int32_t ii = static_cast<int32_t>(roots.size()) - 1; ii >= 0; ii--) {
+        push_ready(ii % n_workers, roots.at(ii));
+    }
+
+    std::vector<std::thread> threads;
+
+    for (int32_t ii = 1; ii < n_workers; ii++) {
+        threads.push_back(std::thread(&task_graph::worker_loop, this, ii));
+    }
+
+    worker_loop(0);
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    deques.clear();
+    pending.reset();
+}
@@ -0,0 +1,110 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TASKGRAPH_HH
+#define TASKGRAPH_HH
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+using std::int32_t;
+using std::uint32_t;
+
+/* Directed acyclic graph of tasks run by a pool of worker threads. A task
+starts as soon as all of its predecessors have finished, there is no global
+barrier between levels. A barrier node is an ordinary task that joins a set
+of tasks, e.g. the HEVC coding of all views of a hierarchical level.
+
+Scheduling is work-stealing: every worker owns a deque of ready tasks, the
+tasks it makes ready are pushed to its own deque and popped LIFO (the
+successor of a view is likely to use the same decoded data), idle workers
+steal FIFO from the other deques. Tasks are expected to be coarse (a view),
+so the deques are protected by plain mutexes. */
+
+class task_graph {
+
+ private:
+
+    struct task_node {
+
+        std::function<void()> work;
+        std::vector<int32_t> successors;
+        int32_t n_predecessors = 0;
+
+    };
+
+    struct worker_deque {
+
+        std::mutex mutex;
+        std::deque<int32_t> tasks;
+
+    };
+
+    std::vector<task_node> nodes;
+
+    /* run state */
+    std::unique_ptr<std::atomic<int32_t>[]> pending;
+    std::vector<std::unique_ptr<worker_deque>> deques;
+    std::atomic<int32_t> n_ready;
+    std::atomic<int32_t> n_remaining;
+    std::mutex sleep_mutex;
+    std::condition_variable wakeup;
+
+    void push_ready(const int32_t worker, const int32_t task);
+    bool pop_ready(const int32_t worker, int32_t &task);
+    void execute(const int32_t worker, const int32_t task);
+    void worker_loop(const int32_t worker);
+
+ public:
+
+    task_graph();
+
+    /* returns the id of the new task */
+    int32_t add_task(std::function<void()> work);
+
+    /* task which runs once every task in joined has finished */
+    int32_t add_barrier(
+        const std::vector<int32_t> &joined,
+        std::function<void()> work);
+
+    /* task after does not start before task before has finished */
+    void add_dependency(const int32_t before, const int32_t after);
+
+    int32_t size() const;
+
+    /* runs every task, returns when all have finished. The calling thread
+    is one of the n_threads workers. */
+    void run(const int32_t n_threads);
+
+};
+
+#endif
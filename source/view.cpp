@@ -25,10 +25,13 @@
 */
 
 #include <string.h>
+#include <atomic>
+#include <string>
 
 #include "view.hh"
 #include "ppm.hh"
 #include "ycbcr.hh"
+#include "viewcache.hh"
 #include "sparsefilter.hh"
 
 void initView(view* view) {
@@ -206,8 +209,8 @@ void setPaths(
 
     /*INTERNAL OUTPUT*/
     sprintf(
-        SAI->path_internal_colorspace_out_ppm,
-        "%s/internal_colorspace/PPM/%01d/%03d_%03d.ppm",
+        SAI->path_internal_colorspace_out,
+        "%s/internal_colorspace/RAW/%01d/%03d_%03d.raw",
         output_dir,
         SAI->level,
         SAI->c,
@@ -238,16 +241,16 @@ void setPaths(
         SAI->r);
 
     sprintf(
-        SAI->path_raw_texture_residual_at_encoder_ppm,
-        "%s/residual/RAW/%01d/%03d_%03d.ppm",
+        SAI->path_raw_texture_residual_at_encoder,
+        "%s/residual/RAW/%01d/%03d_%03d.raw",
         output_dir,
         SAI->level,
         SAI->c,
         SAI->r);
 
     sprintf(
-        SAI->path_raw_prediction_at_encoder_ppm,
-        "%s/prediction/RAW/%01d/%03d_%03d.ppm",
+        SAI->path_raw_prediction_at_encoder,
+        "%s/prediction/RAW/%01d/%03d_%03d.raw",
         output_dir,
         SAI->level,
         SAI->c,
@@ -279,20 +282,6 @@ void setPaths(
         output_dir,
         SAI->level);
 
-    //sprintf(
-    //    SAI->path_raw_texture_residual_at_decoder_ppm,
-    //    "%s/residual/JP2_decoded/%01d/%03d_%03d.ppm",
-    //    output_dir,
-    //    SAI->level,
-    //    SAI->c,
-    //    SAI->r);
-
-    /*to save some disk space we overwrite*/
-    sprintf(
-        SAI->path_raw_texture_residual_at_decoder_ppm,
-        "%s",
-        SAI->path_internal_colorspace_out_ppm);
-
     //sprintf(
     //    SAI->inverse_depth_raw_pgm,
     //    "%s/residual/depth/RAW/%01d/%03d_%03d.pgm",
@@ -302,7 +291,7 @@ void setPaths(
     //    SAI->r);
 }
 
-uint16_t *read_input_ppm(
+static uint16_t *convert_input_ppm(
     const char *input_ppm_path,
     int32_t &nr,
     int32_t &nc,
@@ -352,6 +341,48 @@ uint16_t *read_input_ppm(
     return texture_in_encoder_colorspace;
 }
 
+static std::atomic<bool> shared_inputs_enabled(false);
+
+void share_input_views(const bool enable) {
+    shared_inputs_enabled = enable;
+}
+
+uint16_t *read_input_ppm(
+    const char *input_ppm_path,
+    int32_t &nr,
+    int32_t &nc,
+    int32_t &ncomp,
+    const int32_t bpc,
+    const std::string colorspace) {
+
+    if (!shared_inputs_enabled) {
+        return convert_input_ppm(
+            input_ppm_path,
+            nr,
+            nc,
+            ncomp,
+            bpc,
+            colorspace);
+    }
+
+    /* the view cache keeps the converted views within its budget */
+
+    return viewcache_read_input(
+        std::string(input_ppm_path) + "|" + colorspace + "|" + std::to_string(bpc),
+        nr,
+        nc,
+        ncomp,
+        [&](int32_t &nr1, int32_t &nc1, int32_t &ncomp1) {
+            return convert_input_ppm(
+                input_ppm_path,
+                nr1,
+                nc1,
+                ncomp1,
+                bpc,
+                colorspace);
+        });
+}
+
 void write_output_ppm(
     const uint16_t *texture_view_in_encoder_colorspace,
     const char *output_ppm_path,
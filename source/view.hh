@@ -42,8 +42,6 @@ using std::uint16_t;
 using std::int8_t;
 using std::uint8_t;
 
-#define MEDFILT_DEPTH false
-
 struct view {
 
   uint16_t *color;
@@ -146,11 +144,10 @@ struct view {
   char pgm_residual_depth_path[1024];
   char jp2_residual_depth_path_jp2[1024];
 
-  char path_raw_texture_residual_at_encoder_ppm[1024];
-  char path_raw_prediction_at_encoder_ppm[1024];
-  char path_raw_texture_residual_at_decoder_ppm[1024];
+  char path_raw_texture_residual_at_encoder[1024];
+  char path_raw_prediction_at_encoder[1024];
 
-  char path_internal_colorspace_out_ppm[1024];
+  char path_internal_colorspace_out[1024];
 
   char inverse_depth_raw_pgm[1024];
 
@@ -183,6 +180,12 @@ struct view {
 
 void initView(view* view);
 
+/* reads an input view and converts it to the encoder colorspace. While
+sharing is enabled, the converted views are kept in the view cache
+(viewcache.hh), within its budget, and the encoders of a batch get copies
+of them. */
+void share_input_views(const bool enable);
+
 uint16_t *read_input_ppm(
     const char *input_ppm_path,
     int32_t &nr,
@@ -0,0 +1,628 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "viewcache.hh"
+#include "ppm.hh"
+#include "planar.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <cstring>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct viewcache_entry {
+
+    std::vector<uint16_t> data;
+
+    std::string path; /* spill/reload location */
+
+    int32_t nr, nc, ncomp;
+
+    bool on_disk; /* data also exists at path */
+
+    int32_t pins;
+
+    uint64_t last_use;
+
+    bool released; /* no uses left, dropped when unpinned */
+
+};
+
+struct viewcache_lifetime {
+
+    int32_t remaining_uses;
+
+    int32_t next_use;
+
+    const void *owner; /* the plan next_use refers to */
+
+};
+
+/* entries are keyed by the view itself, so that several encoders of a
+batch (each with its own array of views) can share the cache. Input views
+have no view, they are keyed by VIEWCACHE_INPUT + their index in
+viewcache_inputs. */
+typedef std::pair<const view*, int32_t> viewcache_key;
+
+#define VIEWCACHE_INPUT 2
+
+/* an evicted entry which is written to disk after the mutex is released */
+struct viewcache_spill {
+
+    viewcache_key key;
+
+    std::string path;
+
+    int32_t nr, nc, ncomp;
+
+    std::vector<uint16_t> data;
+
+};
+
+static std::map<viewcache_key, viewcache_entry> viewcache_entries;
+static std::map<viewcache_key, viewcache_lifetime> viewcache_lifetimes;
+static std::mutex viewcache_mutex;
+
+/* number of spills of a key still being written, a cache miss on the key
+waits for them */
+static std::map<viewcache_key, int32_t> viewcache_spilling;
+
+/* entries being read from disk or converted without the mutex, a cache
+miss on the key waits for them */
+static std::set<viewcache_key> viewcache_loading;
+static std::map<std::string, int32_t> viewcache_inputs;
+
+/* signalled when a spill has been written or an input view loaded */
+static std::condition_variable viewcache_io_done;
+
+static int64_t viewcache_budget = 0; /* set with viewcache_set_budget() */
+static int64_t viewcache_bytes = 0;
+static uint64_t viewcache_tick = 0;
+
+static int64_t entry_bytes(const viewcache_entry &entry) {
+    return static_cast<int64_t>(entry.data.size() * sizeof(uint16_t));
+}
+
+static void viewcache_entry_setup(
+    viewcache_entry &entry,
+    const view *SAI,
+    const VIEWCACHE_PLANE plane) {
+
+    entry.nr = SAI->nr;
+    entry.nc = SAI->nc;
+    entry.pins = 0;
+    entry.last_use = 0;
+    entry.released = false;
+
+    if (plane == VIEWCACHE_TEXTURE) {
+        entry.ncomp = SAI->ncomp;
+        entry.path = std::string(SAI->path_internal_colorspace_out);
+        entry.on_disk = false;
+    }
+    else {
+        entry.ncomp = 1;
+        entry.path = std::string(SAI->path_out_pgm);
+        entry.on_disk = true; /* .pgm output is written by the caller */
+    }
+}
+
+struct viewcache_candidate {
+
+    std::map<viewcache_key, viewcache_entry>::iterator it;
+
+    int32_t next_use;
+
+};
+
+/* evicts unpinned entries until the cache fits in the budget. Of the
+entries of one plan owner, the one needed furthest in the future is the
+candidate, ties are broken by least recent use. Entries without uses
+(input views and unmanaged planes) go first, else the least recently used
+candidate of the owners, as their steps are not comparable. Entries not on
+disk yet are moved to spills, to be written with viewcache_write_spills().
+Must be called with the mutex held. */
+static void viewcache_evict(std::vector<viewcache_spill> &spills) {
+
+    std::map<const void*, viewcache_candidate> candidates;
+
+    while (viewcache_bytes > viewcache_budget) {
+
+        candidates.clear();
+
+        for (auto it = viewcache_entries.begin();
+            it != viewcache_entries.end();
+            it++)
+        {
+            if (it->second.pins > 0) {
+                continue;
+            }
+
+            auto lifetime = viewcache_lifetimes.find(it->first);
+
+            const void *owner = nullptr;
+            int32_t next_use = INT32_MAX;
+
+            if (lifetime != viewcache_lifetimes.end()) {
+                owner = lifetime->second.owner;
+                next_use = lifetime->second.next_use;
+            }
+
+            auto candidate = candidates.find(owner);
+
+            if (candidate == candidates.end()) {
+                candidates[owner] = viewcache_candidate{ it, next_use };
+            }
+            else if (
+                next_use > candidate->second.next_use ||
+                (next_use == candidate->second.next_use &&
+                    it->second.last_use < candidate->second.it->second.last_use))
+            {
+                candidate->second = viewcache_candidate{ it, next_use };
+            }
+        }
+
+        if (candidates.empty()) {
+            break; /* everything pinned */
+        }
+
+        auto victim = viewcache_entries.end();
+
+        auto unmanaged = candidates.find(nullptr);
+
+        if (unmanaged != candidates.end()) {
+            victim = unmanaged->second.it;
+        }
+        else {
+            for (auto &candidate : candidates) {
+                if (victim == viewcache_entries.end() ||
+                    candidate.second.it->second.last_use < victim->second.last_use)
+                {
+                    victim = candidate.second.it;
+                }
+            }
+        }
+
+        viewcache_entry &entry = victim->second;
+
+        viewcache_bytes -= entry_bytes(entry);
+
+        if (!entry.on_disk) {
+
+            viewcache_spill spill;
+
+            spill.key = victim->first;
+            spill.path = entry.path;
+            spill.nr = entry.nr;
+            spill.nc = entry.nc;
+            spill.ncomp = entry.ncomp;
+            spill.data = std::move(entry.data);
+
+            viewcache_spilling[spill.key]++;
+
+            spills.push_back(std::move(spill));
+        }
+
+        viewcache_entries.erase(victim);
+
+    }
+}
+
+/* writes the spilled entries, must be called without the mutex */
+static void viewcache_write_spills(std::vector<viewcache_spill> &spills) {
+
+    for (viewcache_spill &spill : spills) {
+
+        aux_write16planar(
+            spill.path.c_str(),
+            spill.nc,
+            spill.nr,
+            spill.ncomp,
+            spill.data.data());
+
+        {
+            std::lock_guard<std::mutex> lock(viewcache_mutex);
+
+            if (--viewcache_spilling[spill.key] == 0) {
+                viewcache_spilling.erase(spill.key);
+            }
+        }
+
+        viewcache_io_done.notify_all();
+    }
+}
+
+void viewcache_set_budget(const int64_t budget_bytes) {
+
+    std::vector<viewcache_spill> spills;
+
+    {
+        std::lock_guard<std::mutex> lock(viewcache_mutex);
+
+        viewcache_budget = budget_bytes;
+        viewcache_evict(spills);
+    }
+
+    viewcache_write_spills(spills);
+}
+
+void viewcache_store(
+    const view *SAI,
+    const VIEWCACHE_PLANE plane,
+    const uint16_t *data) {
+
+    std::vector<viewcache_spill> spills;
+
+    {
+        std::lock_guard<std::mutex> lock(viewcache_mutex);
+
+        viewcache_key key(SAI, plane);
+
+        auto it = viewcache_entries.find(key);
+
+        if (it != viewcache_entries.end()) {
+            viewcache_bytes -= entry_bytes(it->second);
+            viewcache_entries.erase(it);
+        }
+
+        viewcache_entry &entry = viewcache_entries[key];
+
+        viewcache_entry_setup(entry, SAI, plane);
+
+        entry.data.assign(
+            data,
+            data + entry.nr*entry.nc*entry.ncomp);
+
+        entry.last_use = ++viewcache_tick;
+
+        viewcache_bytes += entry_bytes(entry);
+
+        viewcache_evict(spills);
+    }
+
+    viewcache_write_spills(spills);
+}
+
+const uint16_t *viewcache_acquire(
+    const view *SAI,
+    const VIEWCACHE_PLANE plane) {
+
+    std::vector<viewcache_spill> spills;
+
+    std::unique_lock<std::mutex> lock(viewcache_mutex);
+
+    viewcache_key key(SAI, plane);
+
+    auto it = viewcache_entries.find(key);
+
+    /* a spilled entry is read back only once it has been written, and by
+    one reader only */
+    while (it == viewcache_entries.end() &&
+        (viewcache_spilling.count(key) > 0 || viewcache_loading.count(key) > 0))
+    {
+        viewcache_io_done.wait(lock);
+        it = viewcache_entries.find(key);
+    }
+
+    if (it == viewcache_entries.end()) {
+
+        /* cache miss, get it from disk without holding the mutex */
+
+        viewcache_loading.insert(key);
+
+        lock.unlock();
+
+        viewcache_entry entry;
+
+        viewcache_entry_setup(entry, SAI, plane);
+
+        int32_t nc1, nr1, ncomp1;
+        bool success;
+
+        if (plane == VIEWCACHE_TEXTURE) {
+
+            /* spilled texture is raw planar, copy it from the mapping */
+
+            aux_mapped_file mfile;
+            const uint16_t *img = nullptr;
+
+            success = aux_map16planar(entry.path.c_str(), nc1, nr1, ncomp1, mfile, img);
+
+            if (success) {
+                entry.data.assign(img, img + nr1*nc1*ncomp1);
+                aux_unmap_file(mfile);
+            }
+        }
+        else {
+
+            uint16_t *img = nullptr;
+
+            success = aux_read16PGMPPM(entry.path.c_str(), nc1, nr1, ncomp1, img);
+
+            if (success) {
+                entry.data.assign(img, img + nr1*nc1*ncomp1);
+                delete[](img);
+            }
+        }
+
+        if (!success) {
+            printf("Decoded view %03d_%03d not available. Terminating\t...\n",
+                SAI->c,
+                SAI->r);
+            exit(0);
+        }
+
+        entry.ncomp = ncomp1;
+        entry.on_disk = true;
+
+        lock.lock();
+
+        viewcache_loading.erase(key);
+
+        auto inserted = viewcache_entries.insert(std::make_pair(key, std::move(entry)));
+
+        if (inserted.second) {
+            viewcache_bytes += entry_bytes(inserted.first->second);
+        }
+
+        it = inserted.first;
+
+        viewcache_io_done.notify_all();
+
+    }
+
+    it->second.pins++;
+    it->second.last_use = ++viewcache_tick;
+
+    const uint16_t *data = it->second.data.data();
+
+    viewcache_evict(spills);
+
+    lock.unlock();
+
+    viewcache_write_spills(spills);
+
+    return data;
+}
+
+uint16_t *viewcache_read_input(
+    const std::string &name,
+    int32_t &nr,
+    int32_t &nc,
+    int32_t &ncomp,
+    const std::function<uint16_t*(int32_t&, int32_t&, int32_t&)> &convert) {
+
+    std::vector<viewcache_spill> spills;
+
+    std::unique_lock<std::mutex> lock(viewcache_mutex);
+
+    auto input = viewcache_inputs.find(name);
+
+    if (input == viewcache_inputs.end()) {
+        input = viewcache_inputs.insert(std::make_pair(
+            name,
+            static_cast<int32_t>(viewcache_inputs.size()))).first;
+    }
+
+    viewcache_key key(nullptr, VIEWCACHE_INPUT + input->second);
+
+    auto it = viewcache_entries.find(key);
+
+    while (it == viewcache_entries.end() && viewcache_loading.count(key) > 0) {
+        viewcache_io_done.wait(lock);
+        it = viewcache_entries.find(key);
+    }
+
+    uint16_t *texture = nullptr;
+
+    if (it == viewcache_entries.end()) {
+
+        /* cache miss, the first reader converts and the others wait */
+
+        viewcache_loading.insert(key);
+
+        lock.unlock();
+
+        texture = convert(nr, nc, ncomp);
+
+        viewcache_entry entry;
+
+        entry.data.assign(texture, texture + nr*nc*ncomp);
+        entry.path = name;
+        entry.nr = nr;
+        entry.nc = nc;
+        entry.ncomp = ncomp;
+        entry.on_disk = true; /* converted again if evicted */
+        entry.pins = 0;
+        entry.last_use = 0;
+        entry.released = false;
+
+        lock.lock();
+
+        viewcache_loading.erase(key);
+
+        viewcache_bytes += entry_bytes(entry);
+
+        it = viewcache_entries.insert(std::make_pair(key, std::move(entry))).first;
+        it->second.last_use = ++viewcache_tick;
+
+        viewcache_io_done.notify_all();
+    }
+    else {
+
+        /* cache hit, copied without the lock while pinned */
+
+        viewcache_entry &entry = it->second;
+
+        nr = entry.nr;
+        nc = entry.nc;
+        ncomp = entry.ncomp;
+
+        entry.pins++;
+        entry.last_use = ++viewcache_tick;
+
+        lock.unlock();
+
+        texture = new uint16_t[nr*nc*ncomp];
+
+        memcpy(
+            texture,
+            entry.data.data(),
+            sizeof(uint16_t)*nr*nc*ncomp);
+
+        lock.lock();
+
+        entry.pins--;
+    }
+
+    viewcache_evict(spills);
+
+    lock.unlock();
+
+    viewcache_write_spills(spills);
+
+    return texture;
+}
+
+void viewcache_unpin(
+    const view *SAI,
+    const VIEWCACHE_PLANE plane) {
+
+    std::vector<viewcache_spill> spills;
+
+    {
+        std::lock_guard<std::mutex> lock(viewcache_mutex);
+
+        auto it = viewcache_entries.find(
+            viewcache_key(SAI, plane));
+
+        if (it != viewcache_entries.end() && it->second.pins > 0) {
+
+            it->second.pins--;
+
+            if (it->second.pins == 0 && it->second.released) {
+                viewcache_bytes -= entry_bytes(it->second);
+                viewcache_entries.erase(it);
+            }
+        }
+
+        viewcache_evict(spills);
+    }
+
+    viewcache_write_spills(spills);
+}
+
+/* drops the entry without spilling, nobody is going to read it anymore.
+Must be called with the mutex held. */
+static void viewcache_release(const viewcache_key &key) {
+
+    viewcache_lifetimes.erase(key);
+
+    auto it = viewcache_entries.find(key);
+
+    if (it == viewcache_entries.end()) {
+        return;
+    }
+
+    if (it->second.pins > 0) {
+        it->second.released = true;
+        return;
+    }
+
+    viewcache_bytes -= entry_bytes(it->second);
+    viewcache_entries.erase(it);
+}
+
+void viewcache_set_uses(
+    const view *SAI,
+    const VIEWCACHE_PLANE plane,
+    const int32_t n_uses,
+    const int32_t next_use,
+    const void *owner) {
+
+    std::vector<viewcache_spill> spills;
+
+    {
+        std::lock_guard<std::mutex> lock(viewcache_mutex);
+
+        viewcache_key key(SAI, plane);
+
+        if (n_uses <= 0) {
+            viewcache_release(key);
+            return;
+        }
+
+        viewcache_lifetime &lifetime = viewcache_lifetimes[key];
+
+        lifetime.remaining_uses = n_uses;
+        lifetime.next_use = next_use;
+        lifetime.owner = owner;
+
+        viewcache_evict(spills);
+    }
+
+    viewcache_write_spills(spills);
+}
+
+void viewcache_consumed(
+    const view *SAI,
+    const VIEWCACHE_PLANE plane,
+    const int32_t next_use) {
+
+    std::lock_guard<std::mutex> lock(viewcache_mutex);
+
+    viewcache_key key(SAI, plane);
+
+    auto it = viewcache_lifetimes.find(key);
+
+    if (it == viewcache_lifetimes.end()) {
+        return; /* not managed */
+    }
+
+    if (--it->second.remaining_uses <= 0) {
+        viewcache_release(key);
+    }
+    else {
+        it->second.next_use = next_use;
+    }
+}
+
+void viewcache_clear() {
+
+    std::lock_guard<std::mutex> lock(viewcache_mutex);
+
+    viewcache_entries.clear();
+    viewcache_lifetimes.clear();
+    viewcache_inputs.clear();
+    viewcache_bytes = 0;
+}
@@ -0,0 +1,106 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VIEWCACHE_HH
+#define VIEWCACHE_HH
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+using std::int32_t;
+using std::uint32_t;
+
+using std::int16_t;
+using std::uint16_t;
+
+using std::int8_t;
+using std::uint8_t;
+
+using std::int64_t;
+
+#include "view.hh"
+
+/* Process-wide cache of decoded views, keyed by view.
+Decoded texture (in the internal colorspace) and decoded normalized
+disparity are stored here once, and warping, sparse filtering and
+segmentation of the dependent views get them from RAM. If the memory budget
+is exceeded, entries are evicted. An evicted texture is spilled to
+path_internal_colorspace_out as a raw planar image, an evicted normalized
+disparity is read back from path_out_pgm which is always written as output. */
+
+enum VIEWCACHE_PLANE { VIEWCACHE_TEXTURE, VIEWCACHE_NORMDISP };
+
+void viewcache_set_budget(const int64_t budget_bytes);
+
+void viewcache_store(
+    const view *SAI,
+    const VIEWCACHE_PLANE plane,
+    const uint16_t *data);
+
+/* returns the cached plane of SAI, reading it from disk on a cache miss.
+The entry is pinned and the pointer stays valid until viewcache_unpin(). */
+const uint16_t *viewcache_acquire(
+    const view *SAI,
+    const VIEWCACHE_PLANE plane);
+
+/* input views of a batch in the encoder colorspace, shared by its
+encoders and counted in the budget. Returns a copy of the input view
+called name. On a cache miss it is obtained with convert(nr, nc, ncomp),
+without holding the cache; an evicted input view is not written to disk
+but converted again from its source when needed. */
+uint16_t *viewcache_read_input(
+    const std::string &name,
+    int32_t &nr,
+    int32_t &nc,
+    int32_t &ncomp,
+    const std::function<uint16_t*(int32_t&, int32_t&, int32_t&)> &convert);
+
+void viewcache_unpin(
+    const view *SAI,
+    const VIEWCACHE_PLANE plane);
+
+/* lifetime management, used by the view plan (viewplan.hh): n_uses is the
+number of consumer steps still to read the plane, next_use the step of the
+first of them in the plan owner. The entry is released once all uses have
+been consumed. Eviction prefers entries whose next use is furthest away;
+steps of different owners (the encoders of a batch) are not comparable, so
+between owners the least recently used goes first. */
+void viewcache_set_uses(
+    const view *SAI,
+    const VIEWCACHE_PLANE plane,
+    const int32_t n_uses,
+    const int32_t next_use,
+    const void *owner);
+
+void viewcache_consumed(
+    const view *SAI,
+    const VIEWCACHE_PLANE plane,
+    const int32_t next_use);
+
+void viewcache_clear();
+
+#endif
@@ -0,0 +1,421 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "viewplan.hh"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+
+static void add_input(
+    std::vector<int32_t> &inputs,
+    const int32_t i_order) {
+
+    if (std::find(inputs.begin(), inputs.end(), i_order) == inputs.end()) {
+        inputs.push_back(i_order);
+    }
+}
+
+static std::vector<int32_t> views_at_level(
+    view *LF,
+    const int32_t n_views,
+    const int32_t hlevel) {
+
+    std::vector< int32_t > view_indices;
+
+    for (int32_t ii = 0; ii < n_views; ii++) {
+        if ((LF + ii)->level == hlevel) {
+            view_indices.push_back(ii);
+        }
+    }
+
+    /*ascending order of view index at a particular level*/
+    sort(view_indices.begin(), view_indices.end());
+
+    return view_indices;
+}
+
+static void add_resident(
+    std::vector<int64_t> &delta,
+    const int32_t first_step,
+    const int32_t last_step,
+    const int64_t bytes) {
+
+    if (first_step < 0 || last_step < first_step) {
+        return; /* never retained */
+    }
+
+    delta.at(first_step) += bytes;
+    delta.at(last_step + 1) -= bytes;
+}
+
+static void finalize_view_plan(
+    view_plan &plan,
+    view *LF,
+    const int32_t n_views) {
+
+    const int32_t n_steps = static_cast<int32_t>(plan.steps.size());
+
+    plan.texture_uses.assign(n_views, std::vector<int32_t>());
+    plan.normdisp_uses.assign(n_views, std::vector<int32_t>());
+
+    for (int32_t is = 0; is < n_steps; is++) {
+
+        for (int32_t i_order : plan.steps.at(is).texture_inputs) {
+            plan.texture_uses.at(i_order).push_back(is);
+        }
+
+        for (int32_t i_order : plan.steps.at(is).normdisp_inputs) {
+            plan.normdisp_uses.at(i_order).push_back(is);
+        }
+    }
+
+    plan.texture_last_use.assign(n_views, -1);
+    plan.normdisp_last_use.assign(n_views, -1);
+
+    std::vector<int64_t> delta(n_steps + 1, 0);
+
+    for (int32_t ii = 0; ii < n_views; ii++) {
+
+        view *SAI = LF + ii;
+
+        const int64_t plane_bytes =
+            static_cast<int64_t>(SAI->nr) * SAI->nc * sizeof(uint16_t);
+
+        if (plan.texture_uses.at(ii).size() > 0) {
+            plan.texture_last_use.at(ii) = plan.texture_uses.at(ii).back();
+        }
+
+        if (plan.normdisp_uses.at(ii).size() > 0) {
+            plan.normdisp_last_use.at(ii) = plan.normdisp_uses.at(ii).back();
+        }
+
+        add_resident(
+            delta,
+            plan.texture_step.at(ii),
+            plan.texture_last_use.at(ii),
+            plane_bytes * SAI->ncomp);
+
+        add_resident(
+            delta,
+            plan.normdisp_step.at(ii),
+            plan.normdisp_last_use.at(ii),
+            plane_bytes);
+
+    }
+
+    plan.resident_bytes.assign(n_steps, 0);
+
+    plan.peak_bytes = 0;
+    plan.peak_step = 0;
+
+    int64_t resident = 0;
+
+    for (int32_t is = 0; is < n_steps; is++) {
+
+        resident += delta.at(is);
+
+        plan.resident_bytes.at(is) = resident;
+
+        if (resident > plan.peak_bytes) {
+            plan.peak_bytes = resident;
+            plan.peak_step = is;
+        }
+    }
+}
+
+view_plan plan_encoder_views(
+    view *LF,
+    const int32_t n_views,
+    const int32_t n_seg_iterations) {
+
+    view_plan plan;
+
+    plan.texture_step.assign(n_views, -1);
+    plan.normdisp_step.assign(n_views, -1);
+
+    int32_t maxh = get_highest_level(LF, n_views);
+
+    /* see encoder::generate_normalized_disparity() */
+    for (int32_t hlevel = 1; hlevel <= maxh; hlevel++) {
+
+        for (int32_t ii : views_at_level(LF, n_views, hlevel)) {
+
+            view *SAI = LF + ii;
+
+            view_plan_step step;
+            step.i_order = ii;
+
+            if (!(hlevel == 1 && SAI->residual_rate_depth > 0)) {
+                for (int32_t ij = 0; ij < SAI->n_depth_references; ij++) {
+                    add_input(step.normdisp_inputs, SAI->depth_references[ij]);
+                }
+            }
+
+            plan.normdisp_step.at(ii) = static_cast<int32_t>(plan.steps.size());
+            plan.steps.push_back(step);
+
+        }
+    }
+
+    /* see encoder::generate_texture() */
+    for (int32_t hlevel = 1; hlevel <= maxh; hlevel++) {
+
+        for (int32_t ii : views_at_level(LF, n_views, hlevel)) {
+
+            view *SAI = LF + ii;
+
+            view_plan_step step;
+            step.i_order = ii;
+
+            for (int32_t ij = 0; ij < SAI->n_references; ij++) {
+                add_input(step.texture_inputs, SAI->references[ij]);
+                add_input(step.normdisp_inputs, SAI->references[ij]);
+            }
+
+            /* segmentation for sparse filter */
+            if (SAI->n_references > 0 &&
+                SAI->Ms > 0 &&
+                SAI->NNt > 0 &&
+                n_seg_iterations > 0)
+            {
+                add_input(step.normdisp_inputs, ii);
+            }
+
+            plan.texture_step.at(ii) = static_cast<int32_t>(plan.steps.size());
+            plan.steps.push_back(step);
+
+        }
+    }
+
+    finalize_view_plan(plan, LF, n_views);
+
+    return plan;
+}
+
+view_plan plan_decoder_views(
+    view *LF,
+    const int32_t n_views,
+    const int32_t n_seg_iterations) {
+
+    view_plan plan;
+
+    plan.texture_step.assign(n_views, -1);
+    plan.normdisp_step.assign(n_views, -1);
+
+    /* see decoder::decode_views() */
+    for (int32_t ii = 0; ii < n_views; ii++) {
+
+        view *SAI = LF + ii;
+
+        view_plan_step step;
+        step.i_order = ii;
+
+        if (!SAI->has_depth_residual) {
+            for (int32_t ij = 0; ij < SAI->n_depth_references; ij++) {
+                add_input(step.normdisp_inputs, SAI->depth_references[ij]);
+            }
+        }
+
+        for (int32_t ij = 0; ij < SAI->n_references; ij++) {
+            add_input(step.texture_inputs, SAI->references[ij]);
+            add_input(step.normdisp_inputs, SAI->references[ij]);
+        }
+
+        /* segmentation for sparse filter */
+        if (SAI->n_references > 0 &&
+            SAI->use_global_sparse &&
+            n_seg_iterations > 0)
+        {
+            add_input(step.normdisp_inputs, ii);
+        }
+
+        plan.texture_step.at(ii) = static_cast<int32_t>(plan.steps.size());
+        plan.normdisp_step.at(ii) = static_cast<int32_t>(plan.steps.size());
+        plan.steps.push_back(step);
+
+    }
+
+    finalize_view_plan(plan, LF, n_views);
+
+    return plan;
+}
+
+void print_view_plan(
+    const view_plan &plan,
+    view *LF,
+    const int64_t budget_bytes) {
+
+    if (plan.steps.size() == 0) {
+        return;
+    }
+
+    view *SAI = LF + plan.steps.at(plan.peak_step).i_order;
+
+    printf("View plan: %d steps, peak of retained decoded views %.1f MB at view %03d_%03d\n",
+        static_cast<int32_t>(plan.steps.size()),
+        static_cast<double>(plan.peak_bytes) / 1024.0 / 1024.0,
+        SAI->c,
+        SAI->r);
+
+    if (plan.peak_bytes > budget_bytes) {
+        printf("View cache budget of %.1f MB is below the peak, some decoded views will be spilled to disk\n",
+            static_cast<double>(budget_bytes) / 1024.0 / 1024.0);
+    }
+}
+
+static int32_t next_use_after(
+    const std::vector<int32_t> &uses,
+    const int32_t step) {
+
+    auto it = std::upper_bound(uses.begin(), uses.end(), step);
+
+    return it != uses.end() ? *it : INT32_MAX;
+}
+
+/* number of uses of the plane from step on, and the first of them */
+static int32_t uses_from(
+    const view_plan &plan,
+    const int32_t step,
+    const view *SAI,
+    const VIEWCACHE_PLANE plane,
+    int32_t &first_use) {
+
+    const std::vector<int32_t> &uses = plane == VIEWCACHE_TEXTURE ?
+        plan.texture_uses.at(SAI->i_order) :
+        plan.normdisp_uses.at(SAI->i_order);
+
+    auto first = std::lower_bound(uses.begin(), uses.end(), step);
+
+    first_use = first != uses.end() ? *first : INT32_MAX;
+
+    return static_cast<int32_t>(uses.end() - first);
+}
+
+void view_plan_store(
+    const view_plan &plan,
+    const int32_t step,
+    const view *SAI,
+    const VIEWCACHE_PLANE plane,
+    const uint16_t *data) {
+
+    int32_t first_use;
+
+    const int32_t n_uses = uses_from(plan, step, SAI, plane, first_use);
+
+    if (n_uses == 0) {
+        return; /* nobody reads it */
+    }
+
+    viewcache_store(SAI, plane, data);
+    viewcache_set_uses(SAI, plane, n_uses, first_use, &plan);
+}
+
+void view_plan_register(
+    const view_plan &plan,
+    const int32_t step,
+    const view *SAI,
+    const VIEWCACHE_PLANE plane) {
+
+    int32_t first_use;
+
+    const int32_t n_uses = uses_from(plan, step, SAI, plane, first_use);
+
+    if (n_uses == 0) {
+        return;
+    }
+
+    viewcache_set_uses(SAI, plane, n_uses, first_use, &plan);
+}
+
+static void add_producers(
+    std::vector<int32_t> &producers,
+    const std::vector<int32_t> &inputs,
+    const std::vector<int32_t> &producer_step,
+    const int32_t step) {
+
+    for (int32_t i_order : inputs) {
+
+        const int32_t pstep = producer_step.at(i_order);
+
+        /* own plane, or one which is never produced (read from disk) */
+        if (pstep < 0 || pstep == step) {
+            continue;
+        }
+
+        add_input(producers, pstep);
+    }
+}
+
+std::vector<std::vector<int32_t>> view_plan_dependencies(const view_plan &plan) {
+
+    const int32_t n_steps = static_cast<int32_t>(plan.steps.size());
+
+    std::vector<std::vector<int32_t>> dependencies(n_steps);
+
+    for (int32_t step = 0; step < n_steps; step++) {
+
+        const view_plan_step &pstep = plan.steps.at(step);
+
+        add_producers(
+            dependencies.at(step),
+            pstep.texture_inputs,
+            plan.texture_step,
+            step);
+
+        add_producers(
+            dependencies.at(step),
+            pstep.normdisp_inputs,
+            plan.normdisp_step,
+            step);
+
+        sort(dependencies.at(step).begin(), dependencies.at(step).end());
+    }
+
+    return dependencies;
+}
+
+void view_plan_step_done(
+    const view_plan &plan,
+    const int32_t step,
+    view *LF) {
+
+    const view_plan_step &pstep = plan.steps.at(step);
+
+    for (int32_t i_order : pstep.texture_inputs) {
+        viewcache_consumed(
+            LF + i_order,
+            VIEWCACHE_TEXTURE,
+            next_use_after(plan.texture_uses.at(i_order), step));
+    }
+
+    for (int32_t i_order : pstep.normdisp_inputs) {
+        viewcache_consumed(
+            LF + i_order,
+            VIEWCACHE_NORMDISP,
+            next_use_after(plan.normdisp_uses.at(i_order), step));
+    }
+}
@@ -0,0 +1,133 @@
+/*BSD 2-Clause License
+* Copyright(c) 2019, Pekka Astola
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met :
+*
+* 1. Redistributions of source code must retain the above copyright notice, this
+* list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+* this list of conditions and the following disclaimer in the documentation
+* and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VIEWPLAN_HH
+#define VIEWPLAN_HH
+
+#include <cstdint>
+#include <vector>
+
+using std::int32_t;
+using std::uint32_t;
+
+using std::int16_t;
+using std::uint16_t;
+
+using std::int8_t;
+using std::uint8_t;
+
+using std::int64_t;
+
+#include "view.hh"
+#include "viewcache.hh"
+
+/* The references and depth_references of the views give the complete
+future-use graph of every decoded view before encoding or decoding starts.
+The view plan lists the processing steps in order, the decoded planes each
+step reads, and from this the last consumer of every decoded texture and
+normalized disparity together with the resulting peak memory. The plan drives
+the lifetimes in the view cache: a plane is retained only while it still has
+consumers and released right after its last one. */
+
+struct view_plan_step {
+
+    int32_t i_order; /* view processed at this step */
+
+    std::vector<int32_t> texture_inputs;
+    std::vector<int32_t> normdisp_inputs;
+
+};
+
+struct view_plan {
+
+    std::vector<view_plan_step> steps;
+
+    /* per view, the step producing the plane, -1 if never produced */
+    std::vector<int32_t> texture_step;
+    std::vector<int32_t> normdisp_step;
+
+    /* per view, ascending steps reading the plane */
+    std::vector<std::vector<int32_t>> texture_uses;
+    std::vector<std::vector<int32_t>> normdisp_uses;
+
+    /* per view, step of the last consumer, -1 if the plane is never read */
+    std::vector<int32_t> texture_last_use;
+    std::vector<int32_t> normdisp_last_use;
+
+    /* bytes of decoded views that must be retained after each step */
+    std::vector<int64_t> resident_bytes;
+
+    int64_t peak_bytes;
+    int32_t peak_step;
+
+};
+
+/* encoder order: normalized disparity for all levels first,
+then texture level by level */
+view_plan plan_encoder_views(
+    view *LF,
+    const int32_t n_views,
+    const int32_t n_seg_iterations);
+
+/* decoder order: normalized disparity and texture view by view */
+view_plan plan_decoder_views(
+    view *LF,
+    const int32_t n_views,
+    const int32_t n_seg_iterations);
+
+void print_view_plan(
+    const view_plan &plan,
+    view *LF,
+    const int64_t budget_bytes);
+
+/* stores the plane produced at step, if some later step reads it */
+void view_plan_store(
+    const view_plan &plan,
+    const int32_t step,
+    const view *SAI,
+    const VIEWCACHE_PLANE plane,
+    const uint16_t *data);
+
+/* registers the uses from step on of a plane which is on disk but is not
+produced by the plan, e.g., normalized disparity taken from another
+encoder. It is read on its first use and released after the last. */
+void view_plan_register(
+    const view_plan &plan,
+    const int32_t step,
+    const view *SAI,
+    const VIEWCACHE_PLANE plane);
+
+/* per step, the ascending earlier steps producing its inputs, i.e., the
+steps it has to wait for when steps run concurrently */
+std::vector<std::vector<int32_t>> view_plan_dependencies(const view_plan &plan);
+
+/* signals that step has finished reading its inputs */
+void view_plan_step_done(
+    const view_plan &plan,
+    const int32_t step,
+    view *LF);
+
+#endif
@@ -30,65 +30,641 @@
 #include <cstdlib>
 #include <cmath>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <functional>
+
+#if defined(__SSE4_1__) || defined(__AVX__)
+#define WARP_SSE41
+#include <smmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define WARP_AVX2
+#include <immintrin.h>
+#endif
+
+/* threads of a single warp, 1 warps serially */
+static std::atomic<int32_t> warp_threads(1);
+
+/* displacement of the pixels of view0 in view1 */
+struct warp_params {
+
+    float min_inv_d;
+    float ddx, ddy;
+
+};
+
+/* column and row shifts and disparities of the normalized disparity values
+D[0..n-1]. The operations are the ones of the original scalar code in the
+same order (the division by 2^D_DEPTH is exact as a multiplication), so the
+results are bit-identical. */
+static void warp_shifts_scalar(
+    const uint16_t *D,
+    const int32_t n,
+    const warp_params &wp,
+    int32_t *col_shift,
+    int32_t *row_shift,
+    float *disp) {
+
+    for (int32_t k = 0; k < n; k++) {
+
+        float dispk =
+            (static_cast<float>(D[k]) - wp.min_inv_d)
+            / static_cast<float>(1 << D_DEPTH);
+
+        float DM_COL = dispk * wp.ddx;
+        float DM_ROW = dispk * wp.ddy;
+
+        col_shift[k] = static_cast<int32_t>(floor(DM_COL + 0.5f));
+        row_shift[k] = static_cast<int32_t>(floor(DM_ROW + 0.5f));
+
+        disp[k] = dispk;
+    }
+}
+
+#if defined(WARP_SSE41) && !defined(WARP_AVX2)
+static int32_t warp_shifts_sse41(
+    const uint16_t *D,
+    const int32_t n,
+    const warp_params &wp,
+    int32_t *col_shift,
+    int32_t *row_shift,
+    float *disp) {
+
+    const __m128 vmin = _mm_set1_ps(wp.min_inv_d);
+    const __m128 vscale = _mm_set1_ps(1.0f / static_cast<float>(1 << D_DEPTH));
+    const __m128 vddx = _mm_set1_ps(wp.ddx);
+    const __m128 vddy = _mm_set1_ps(wp.ddy);
+    const __m128 vhalf = _mm_set1_ps(0.5f);
+
+    int32_t k = 0;
+
+    for (; k + 4 <= n; k += 4) {
+
+        __m128i d32 = _mm_cvtepu16_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(D + k)));
+
+        __m128 vdisp = _mm_mul_ps(
+            _mm_sub_ps(_mm_cvtepi32_ps(d32), vmin),
+            vscale);
+
+        __m128i vsc = _mm_cvtps_epi32(
+            _mm_floor_ps(_mm_add_ps(_mm_mul_ps(vdisp, vddx), vhalf)));
+        __m128i vsr = _mm_cvtps_epi32(
+            _mm_floor_ps(_mm_add_ps(_mm_mul_ps(vdisp, vddy), vhalf)));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(col_shift + k), vsc);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row_shift + k), vsr);
+        _mm_storeu_ps(disp + k, vdisp);
+    }
+
+    return k;
+}
+#endif
+
+#ifdef WARP_AVX2
+static int32_t warp_shifts_avx2(
+    const uint16_t *D,
+    const int32_t n,
+    const warp_params &wp,
+    int32_t *col_shift,
+    int32_t *row_shift,
+    float *disp) {
+
+    const __m256 vmin = _mm256_set1_ps(wp.min_inv_d);
+    const __m256 vscale = _mm256_set1_ps(1.0f / static_cast<float>(1 << D_DEPTH));
+    const __m256 vddx = _mm256_set1_ps(wp.ddx);
+    const __m256 vddy = _mm256_set1_ps(wp.ddy);
+    const __m256 vhalf = _mm256_set1_ps(0.5f);
+
+    int32_t k = 0;
+
+    for (; k + 8 <= n; k += 8) {
+
+        __m256i d32 = _mm256_cvtepu16_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(D + k)));
+
+        __m256 vdisp = _mm256_mul_ps(
+            _mm256_sub_ps(_mm256_cvtepi32_ps(d32), vmin),
+            vscale);
+
+        /* no fused multiply-add, the product is rounded before the
+        addition as in the scalar code */
+        __m256i vsc = _mm256_cvtps_epi32(
+            _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(vdisp, vddx), vhalf)));
+        __m256i vsr = _mm256_cvtps_epi32(
+            _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(vdisp, vddy), vhalf)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(col_shift + k), vsc);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(row_shift + k), vsr);
+        _mm256_storeu_ps(disp + k, vdisp);
+    }
+
+    return k;
+}
+#endif
+
+static void warp_shifts(
+    const uint16_t *D,
+    const int32_t n,
+    const warp_params &wp,
+    int32_t *col_shift,
+    int32_t *row_shift,
+    float *disp) {
+
+    int32_t k = 0;
+
+#if defined(WARP_AVX2)
+    k = warp_shifts_avx2(D, n, wp, col_shift, row_shift, disp);
+#elif defined(WARP_SSE41)
+    k = warp_shifts_sse41(D, n, wp, col_shift, row_shift, disp);
+#endif
+
+    warp_shifts_scalar(
+        D + k,
+        n - k,
+        wp,
+        col_shift + k,
+        row_shift + k,
+        disp + k);
+}
+
+void make_warp_table(
+    const view *view0,
+    const view *view1,
+    const uint16_t *normdisp0,
+    warp_table &table) {
+
+    const int32_t nrnc = view0->nr * view0->nc;
+
+    uint16_t dmin = 65535, dmax = 0;
+
+    for (int32_t ij = 0; ij < nrnc; ij++) {
+        dmin = std::min(dmin, normdisp0[ij]);
+        dmax = std::max(dmax, normdisp0[ij]);
+    }
+
+    if (nrnc == 0) {
+        dmin = dmax = 0;
+    }
+
+    /* only the values present in normdisp0 */
+
+    const int32_t n = dmax - dmin + 1;
+
+    std::vector<uint16_t> values(n);
+
+    for (int32_t k = 0; k < n; k++) {
+        values[k] = static_cast<uint16_t>(dmin + k);
+    }
+
+    warp_params wp;
+
+    wp.min_inv_d = static_cast<float>(view0->min_inv_d);
+    wp.ddy = view0->y - view1->y;
+    wp.ddx = view0->x - view1->x;
+
+    table.d0 = dmin;
+    table.col_shift.resize(n);
+    table.row_shift.resize(n);
+    table.disp.resize(n);
+
+    warp_shifts(
+        values.data(),
+        n,
+        wp,
+        table.col_shift.data(),
+        table.row_shift.data(),
+        table.disp.data());
+}
 
 void warpView0_to_View1(
     view *view0, 
     view *view1, 
+    const uint16_t *texture0,
+    const uint16_t *normdisp0,
     uint16_t *warpedColor,
     uint16_t *warpedDepth, 
     float *DispTarg) {
 
-  /*this function forward warps from view0 to view1 for both color and depth*/
+  warp_table table;
+
+  make_warp_table(view0, view1, normdisp0, table);
+
+  warpView0_to_View1(
+      view0,
+      table,
+      texture0,
+      normdisp0,
+      warpedColor,
+      warpedDepth,
+      DispTarg);
+}
+
+void warping_set_threads(const int32_t n_threads) {
+    warp_threads = std::max(1, n_threads);
+}
+
+/* body(first, last) over [0, n) split into n_strips contiguous strips, one
+thread per strip */
+static void run_strips(
+    const int32_t n,
+    const int32_t n_strips,
+    const std::function<void(const int32_t, const int32_t)> &body) {
+
+    std::vector<std::thread> threads;
+
+    for (int32_t is = 1; is < n_strips; is++) {
+
+        const int32_t first = static_cast<int32_t>(
+            static_cast<int64_t>(n) * is / n_strips);
+        const int32_t last = static_cast<int32_t>(
+            static_cast<int64_t>(n) * (is + 1) / n_strips);
+
+        threads.emplace_back(body, first, last);
+    }
+
+    body(0, static_cast<int32_t>(static_cast<int64_t>(n) / n_strips));
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+/* Forward warp with the source columns split into strips. The strips
+scatter into a shared z-buffer of keys (table index + 1) << 32 | ~ij, a
+larger key has a larger disparity or the same disparity from an earlier
+source pixel. The atomic max of the keys therefore picks the same winner as
+the serial z-test in source order. Zero marks a target nothing warped to. */
+static std::unique_ptr<std::atomic<uint64_t>[]> warp_parallel_keys(
+    const view *view0,
+    const warp_table &table,
+    const uint16_t *DD1,
+    const int32_t n_strips) {
+
+    const int32_t nr = view0->nr;
+    const int32_t nc = view0->nc;
+    const int32_t nrnc = nr * nc;
+
+    const int32_t *col_shift = table.col_shift.data();
+    const int32_t *row_shift = table.row_shift.data();
+
+    std::unique_ptr<std::atomic<uint64_t>[]> zkey(
+        new std::atomic<uint64_t>[nrnc]);
+
+    run_strips(nrnc, n_strips, [&](const int32_t first, const int32_t last) {
+        for (int32_t ij = first; ij < last; ij++) {
+            zkey[ij].store(0, std::memory_order_relaxed);
+        }
+    });
+
+    run_strips(nc, n_strips, [&](const int32_t first, const int32_t last) {
+
+        for (int32_t ix = first; ix < last; ix++) {
 
-  float ddy = view0->y - view1->y;
-  float ddx = view0->x - view1->x;
+            for (int32_t iy = 0; iy < nr; iy++) {
 
-  uint16_t *AA1 = view0->color;
-  uint16_t *DD1 = view0->depth;
+                const int32_t ij = iy + ix * nr;
+                const int32_t d = DD1[ij] - table.d0;
+
+                const int32_t ixnew = ix + col_shift[d];
+                const int32_t iynew = iy + row_shift[d];
+
+                if (iynew >= 0 && ixnew >= 0 && ixnew < nc && iynew < nr) {
+
+                    const int32_t indnew = iynew + ixnew * nr;
+
+                    const uint64_t key =
+                        (static_cast<uint64_t>(d + 1) << 32) |
+                        static_cast<uint64_t>(~static_cast<uint32_t>(ij));
+
+                    uint64_t current =
+                        zkey[indnew].load(std::memory_order_relaxed);
+
+                    while (
+                        current < key &&
+                        !zkey[indnew].compare_exchange_weak(
+                            current,
+                            key,
+                            std::memory_order_relaxed)) {
+                    }
+                }
+            }
+        }
+    });
+
+    return zkey;
+}
+
+/* outputs of warpView0_to_View1 filled from the winners */
+static void warp_parallel(
+    const view *view0,
+    const warp_table &table,
+    const uint16_t *AA1,
+    const uint16_t *DD1,
+    uint16_t *warpedColor,
+    uint16_t *warpedDepth,
+    float *DispTarg,
+    const int32_t n_strips) {
 
-  memset(warpedColor, 0, sizeof(uint16_t)*view0->nr*view0->nc * 3);
-  memset(warpedDepth, 0, sizeof(uint16_t)*view0->nr*view0->nc);
+    const int32_t nrnc = view0->nr * view0->nc;
+    const int32_t ncomp = view0->ncomp;
+
+    const float *disp = table.disp.data();
+
+    std::unique_ptr<std::atomic<uint64_t>[]> zkey =
+        warp_parallel_keys(view0, table, DD1, n_strips);
+
+    run_strips(nrnc, n_strips, [&](const int32_t first, const int32_t last) {
+
+        for (int32_t indnew = first; indnew < last; indnew++) {
+
+            const uint64_t key = zkey[indnew].load(std::memory_order_relaxed);
+
+            if (key == 0) {
+
+                DispTarg[indnew] = INIT_DISPARITY_VALUE;
+                warpedDepth[indnew] = 0;
+
+                for (int32_t icomp = 0; icomp < 3; icomp++) {
+                    warpedColor[indnew + nrnc*icomp] = 0;
+                }
+
+                continue;
+            }
+
+            const int32_t d = static_cast<int32_t>(key >> 32) - 1;
+            const int32_t ij = static_cast<int32_t>(
+                ~static_cast<uint32_t>(key));
+
+            DispTarg[indnew] = disp[d];
+            warpedDepth[indnew] = DD1[ij];
+
+            for (int32_t icomp = 0; icomp < 3; icomp++) {
+                warpedColor[indnew + nrnc*icomp] =
+                    icomp < ncomp ? AA1[ij + nrnc*icomp] : 0;
+            }
+        }
+    });
+}
+
+void warpView0_to_View1_source(
+    view *view0,
+    const warp_table &table,
+    const uint16_t *normdisp0,
+    uint32_t *source) {
+
+    const uint16_t *DD1 = normdisp0;
+
+    const int32_t nr = view0->nr;
+    const int32_t nc = view0->nc;
+    const int32_t nrnc = nr * nc;
+
+    const int32_t n_strips = std::min(warp_threads.load(), nc);
+
+    if (n_strips > 1) {
+
+        std::unique_ptr<std::atomic<uint64_t>[]> zkey =
+            warp_parallel_keys(view0, table, DD1, n_strips);
+
+        run_strips(nrnc, n_strips, [&](const int32_t first, const int32_t last) {
+
+            for (int32_t indnew = first; indnew < last; indnew++) {
+
+                const uint64_t key =
+                    zkey[indnew].load(std::memory_order_relaxed);
+
+                source[indnew] = key == 0 ?
+                    WARP_NO_SOURCE :
+                    ~static_cast<uint32_t>(key);
+            }
+        });
+
+        return;
+    }
+
+    const int32_t *col_shift = table.col_shift.data();
+    const int32_t *row_shift = table.row_shift.data();
+
+    for (int32_t ij = 0; ij < nrnc; ij++) {
+        source[ij] = WARP_NO_SOURCE;
+    }
+
+    /* the disparity grows with the normalized disparity value, so the
+    z-test compares the values of the current and the new source pixel */
+
+    for (int32_t ix = 0; ix < nc; ix++) {
+
+        for (int32_t iy = 0; iy < nr; iy++) {
+
+            const int32_t ij = iy + ix * nr;
+            const int32_t d = DD1[ij] - table.d0;
+
+            const int32_t ixnew = ix + col_shift[d];
+            const int32_t iynew = iy + row_shift[d];
+
+            if (iynew >= 0 && ixnew >= 0 && ixnew < nc && iynew < nr) {
+
+                const int32_t indnew = iynew + ixnew * nr;
+                const uint32_t current = source[indnew];
+
+                if (current == WARP_NO_SOURCE || DD1[current] < DD1[ij]) {
+                    source[indnew] = static_cast<uint32_t>(ij);
+                }
+            }
+        }
+    }
+}
+
+void warpView0_to_View1(
+    view *view0, 
+    const warp_table &table,
+    const uint16_t *texture0,
+    const uint16_t *normdisp0,
+    uint16_t *warpedColor,
+    uint16_t *warpedDepth, 
+    float *DispTarg) {
+
+  /*this function forward warps from view0 to view1 for both color and depth,
+  texture0 and normdisp0 are the decoded texture and normalized disparity of view0*/
+
+  const uint16_t *AA1 = texture0;
+  const uint16_t *DD1 = normdisp0;
+
+  const int32_t nr = view0->nr;
+  const int32_t nc = view0->nc;
+  const int32_t nrnc = nr * nc;
+
+  const int32_t n_strips = std::min(warp_threads.load(), nc);
+
+  if (n_strips > 1) {
+
+      warp_parallel(
+          view0,
+          table,
+          AA1,
+          DD1,
+          warpedColor,
+          warpedDepth,
+          DispTarg,
+          n_strips);
+
+      return;
+  }
+
+  const int32_t *col_shift = table.col_shift.data();
+  const int32_t *row_shift = table.row_shift.data();
+  const float *disp = table.disp.data();
+
+  memset(warpedColor, 0, sizeof(uint16_t)*nrnc * 3);
+  memset(warpedDepth, 0, sizeof(uint16_t)*nrnc);
   //memset(DispTarg, 0, sizeof(float)*view0->nr*view0->nc);
 
-  for (int32_t ij = 0; ij < view0->nr * view0->nc; ij++) {
+  for (int32_t ij = 0; ij < nrnc; ij++) {
     DispTarg[ij] = INIT_DISPARITY_VALUE;
   }
 
-  for (int32_t ij = 0; ij < view0->nr * view0->nc; ij++) {
+  /* source order, the first pixel with the largest disparity wins a
+  target */
 
-    float disp = 
-        (static_cast<float>(DD1[ij]) - static_cast<float>(view0->min_inv_d))
-        / static_cast<float>(1 << D_DEPTH);
+  for (int32_t ix = 0; ix < nc; ix++) {
 
-    float DM_COL = disp * ddx;
-    float DM_ROW = disp * ddy;
+    for (int32_t iy = 0; iy < nr; iy++) {
 
-    int32_t iy = ij % view0->nr;  //row
-    int32_t ix = (ij - iy) / view0->nr;  //col
+      const int32_t ij = iy + ix * nr;
+      const int32_t d = DD1[ij] - table.d0;
 
-    int32_t ixnew = ix + static_cast<int32_t>( floor(DM_COL + 0.5f) );
-    int32_t iynew = iy + static_cast<int32_t>( floor(DM_ROW + 0.5f) );
+      const int32_t ixnew = ix + col_shift[d];
+      const int32_t iynew = iy + row_shift[d];
 
-    if (
-        iynew >= 0 &&  
-        ixnew >= 0 && 
-        ixnew < view0->nc && 
-        iynew < view0->nr) {
+      if (iynew >= 0 && ixnew >= 0 && ixnew < nc && iynew < nr) {
 
-      int32_t indnew = iynew + ixnew * view0->nr;
+        const int32_t indnew = iynew + ixnew * nr;
 
-      if (DispTarg[indnew] < disp) {
+        if (DispTarg[indnew] < disp[d]) {
 
-        DispTarg[indnew] = disp;
-        warpedDepth[indnew] = DD1[ij];
+          DispTarg[indnew] = disp[d];
+          warpedDepth[indnew] = DD1[ij];
 
-        for (int32_t icomp = 0; icomp < view0->ncomp; icomp++) {
+          for (int32_t icomp = 0; icomp < view0->ncomp; icomp++) {
 
-            warpedColor[indnew + view0->nr * view0->nc*icomp] = 
-                AA1[ij+ view0->nr * view0->nc*icomp];
+              warpedColor[indnew + nrnc*icomp] =
+                  AA1[ij + nrnc*icomp];
 
+          }
         }
       }
     }
   }
 }
+
+void warpView0_to_View1_disparity(
+    view *view0,
+    const warp_table &table,
+    const uint16_t *normdisp0,
+    uint16_t *warpedDepth,
+    uint8_t *available) {
+
+    /* the disparity grows with the normalized disparity value, so the
+    warped value is the largest one moved to a target, whichever source
+    pixel it comes from */
+
+    const uint16_t *DD1 = normdisp0;
+
+    const int32_t nr = view0->nr;
+    const int32_t nc = view0->nc;
+    const int32_t nrnc = nr * nc;
+
+    const int32_t *col_shift = table.col_shift.data();
+    const int32_t *row_shift = table.row_shift.data();
+
+    const int32_t n_strips = std::min(warp_threads.load(), nc);
+
+    if (n_strips > 1) {
+
+        /* value + 1, 0 where nothing is warped to */
+        std::unique_ptr<std::atomic<uint32_t>[]> zmax(
+            new std::atomic<uint32_t>[nrnc]);
+
+        run_strips(nrnc, n_strips, [&](const int32_t first, const int32_t last) {
+            for (int32_t ij = first; ij < last; ij++) {
+                zmax[ij].store(0, std::memory_order_relaxed);
+            }
+        });
+
+        run_strips(nc, n_strips, [&](const int32_t first, const int32_t last) {
+
+            for (int32_t ix = first; ix < last; ix++) {
+
+                for (int32_t iy = 0; iy < nr; iy++) {
+
+                    const int32_t ij = iy + ix * nr;
+                    const int32_t d = DD1[ij] - table.d0;
+
+                    const int32_t ixnew = ix + col_shift[d];
+                    const int32_t iynew = iy + row_shift[d];
+
+                    if (iynew >= 0 && ixnew >= 0 && ixnew < nc && iynew < nr) {
+
+                        const int32_t indnew = iynew + ixnew * nr;
+                        const uint32_t value = DD1[ij] + 1;
+
+                        uint32_t current =
+                            zmax[indnew].load(std::memory_order_relaxed);
+
+                        while (
+                            current < value &&
+                            !zmax[indnew].compare_exchange_weak(
+                                current,
+                                value,
+                                std::memory_order_relaxed)) {
+                        }
+                    }
+                }
+            }
+        });
+
+        run_strips(nrnc, n_strips, [&](const int32_t first, const int32_t last) {
+
+            for (int32_t indnew = first; indnew < last; indnew++) {
+
+                const uint32_t value =
+                    zmax[indnew].load(std::memory_order_relaxed);
+
+                available[indnew] = value > 0;
+                warpedDepth[indnew] =
+                    value > 0 ? static_cast<uint16_t>(value - 1) : 0;
+            }
+        });
+
+        return;
+    }
+
+    memset(warpedDepth, 0, sizeof(uint16_t)*nrnc);
+    memset(available, 0, sizeof(uint8_t)*nrnc);
+
+    for (int32_t ix = 0; ix < nc; ix++) {
+
+        for (int32_t iy = 0; iy < nr; iy++) {
+
+            const int32_t ij = iy + ix * nr;
+            const int32_t d = DD1[ij] - table.d0;
+
+            const int32_t ixnew = ix + col_shift[d];
+            const int32_t iynew = iy + row_shift[d];
+
+            if (iynew >= 0 && ixnew >= 0 && ixnew < nc && iynew < nr) {
+
+                const int32_t indnew = iynew + ixnew * nr;
+
+                if (!available[indnew] || warpedDepth[indnew] < DD1[ij]) {
+                    warpedDepth[indnew] = DD1[ij];
+                    available[indnew] = 1;
+                }
+            }
+        }
+    }
+}
@@ -38,15 +38,73 @@ using std::uint16_t;
 using std::int8_t;
 using std::uint8_t;
 
+#include <vector>
+
 #include "view.hh"
 
 #define INIT_DISPARITY_VALUE -10000.0 /* Bug fix from VM1.0. Introduced because -1.0 is no longer a good initial value since we can have negative disparity as well.*/
 
+#define WARP_NO_SOURCE 0xFFFFFFFFu /* target pixel not warped to */
+
+/* column and row shifts and disparities of view0 pixels in view1, indexed by
+normalized disparity value - d0. Built once per reference pair, it replaces
+the float math of the warping loop. */
+struct warp_table {
+
+    int32_t d0 = 0;
+
+    std::vector<int32_t> col_shift;
+    std::vector<int32_t> row_shift;
+    std::vector<float> disp;
+
+};
+
+/* number of threads of a single warp, default 1. With more than one thread
+the source columns are split into strips warped in parallel, the result is
+identical to the serial warp. */
+void warping_set_threads(const int32_t n_threads);
+
+/* table covering the values of normdisp0 */
+void make_warp_table(
+    const view *view0,
+    const view *view1,
+    const uint16_t *normdisp0,
+    warp_table &table);
+
 void warpView0_to_View1(
     view *view0, 
     view *view1, 
+    const uint16_t *texture0,
+    const uint16_t *normdisp0,
     uint16_t *warpedColor,
     uint16_t *warpedDepth, 
     float *DispTarg);
 
+void warpView0_to_View1(
+    view *view0, 
+    const warp_table &table,
+    const uint16_t *texture0,
+    const uint16_t *normdisp0,
+    uint16_t *warpedColor,
+    uint16_t *warpedDepth, 
+    float *DispTarg);
+
+/* forward warps the geometry only, source[ij] is the pixel of view0 which
+warpView0_to_View1 would move to pixel ij of view1, or WARP_NO_SOURCE */
+void warpView0_to_View1_source(
+    view *view0,
+    const warp_table &table,
+    const uint16_t *normdisp0,
+    uint32_t *source);
+
+/* forward warps the normalized disparity only, warpedDepth is what
+warpView0_to_View1 would write and available[ij] is nonzero where its
+DispTarg would be set */
+void warpView0_to_View1_disparity(
+    view *view0,
+    const warp_table &table,
+    const uint16_t *normdisp0,
+    uint16_t *warpedDepth,
+    uint8_t *available);
+
 #endif
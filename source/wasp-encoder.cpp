@@ -31,6 +31,11 @@ int main(int argc, char* argv[]) {
 
     WaSPConfig settings(argc, argv, "encoder");
 
+    if (settings.WaSP_setup.config_files.size() > 1) {
+        encoder::encode_batch(settings.WaSP_setup);
+        exit(0);
+    }
+
     encoder wasp_encoder(settings.WaSP_setup);
 
     wasp_encoder.encode();